@@ -0,0 +1,28 @@
+#ifndef SOURCE_GENERATOR_HPP
+#define SOURCE_GENERATOR_HPP
+
+#include <cstddef>
+#include <string>
+
+// Builds machine-generated looking PolyLang sources of roughly `bytes` bytes:
+// many small functions with indented bodies, comments, long identifiers and
+// numeric literals, each followed by a call.
+inline std::string generateSource(std::size_t bytes) {
+  std::string source;
+  source.reserve(bytes + 256);
+
+  for (std::size_t i = 0; source.size() < bytes; i++) {
+    std::string name = "generated_kernel_function_" + std::to_string(i);
+
+    source += "// kernel " + std::to_string(i) + " emitted by the generator\n";
+    source += "def " + name + "(input_value_alpha, input_value_beta)\n";
+    source += "        return input_value_alpha * 2.5 + input_value_beta * " +
+              std::to_string(i % 97) + " - (input_value_alpha + 1)\n";
+    source += "end\n";
+    source += name + "(" + std::to_string(i) + ", 3.14159)\n";
+  }
+
+  return source;
+}
+
+#endif // !SOURCE_GENERATOR_HPP
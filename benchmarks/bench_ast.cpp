@@ -0,0 +1,239 @@
+#include "AstCache.hpp"
+#include "FlatAst.hpp"
+#include "Parser.hpp"
+#include "SourceGenerator.hpp"
+#include "TokenBuffer.hpp"
+#include "Visitor.hpp"
+
+#include <benchmark/benchmark.h>
+
+// A small analysis pass: counts the nodes of a tree.
+struct NodeCounter : AstVisitor<NodeCounter, std::size_t> {
+  std::size_t visit(const NumberExpr &) { return 1; }
+  std::size_t visit(const VariableExpr &) { return 1; }
+  std::size_t visit(const BinaryExpr &expr) {
+    return 1 + dispatch(*expr.left()) + dispatch(*expr.right());
+  }
+  std::size_t visit(const CallExpr &expr) {
+    std::size_t count = 1;
+    for (const auto &arg : expr.args)
+      count += dispatch(*arg);
+    return count;
+  }
+
+  std::size_t visit(const PrototypeStmt &) { return 1; }
+  std::size_t visit(const FunctionStmt &stmt) {
+    return 1 + dispatch(*stmt.proto) + dispatch(*stmt.body);
+  }
+  std::size_t visit(const BlockStmt &stmt) {
+    std::size_t count = 1;
+    for (const auto &statement : stmt.statements)
+      count += dispatch(*statement);
+    return count + (stmt.returnStmt ? dispatch(*stmt.returnStmt) : 0);
+  }
+  std::size_t visit(const ReturnStmt &stmt) {
+    return 1 + (stmt.returnValue ? dispatch(*stmt.returnValue) : 0);
+  }
+  std::size_t visit(const ExpressionStmt &stmt) {
+    return 1 + dispatch(*stmt.body);
+  }
+  std::size_t visit(const LetStmt &stmt) { return 1 + dispatch(*stmt.value); }
+  std::size_t visit(const AssignStmt &stmt) {
+    return 1 + dispatch(*stmt.value);
+  }
+  std::size_t visit(const IfStmt &stmt) {
+    return 1 + dispatch(*stmt.condition) + dispatch(*stmt.thenBlock) +
+           (stmt.elseIf ? dispatch(*stmt.elseIf) : 0) +
+           (stmt.elseBlock ? dispatch(*stmt.elseBlock) : 0);
+  }
+};
+
+// The same pass behind a virtual interface, the way passes were dispatched
+// before `AstVisitor`.
+struct VirtualPass {
+  virtual ~VirtualPass() = default;
+  virtual std::size_t visit(const NumberExpr &) = 0;
+  virtual std::size_t visit(const VariableExpr &) = 0;
+  virtual std::size_t visit(const BinaryExpr &) = 0;
+  virtual std::size_t visit(const CallExpr &) = 0;
+  virtual std::size_t visit(const Stmt &) = 0;
+};
+
+struct VirtualNodeCounter : VirtualPass {
+  // hidden from the optimizer so the calls are not devirtualized
+  VirtualPass *m_pass = this;
+
+  VirtualNodeCounter() { benchmark::DoNotOptimize(m_pass); }
+
+  std::size_t dispatch(const Expr &expr) {
+    switch (expr.type()) {
+    case AstType::NumberExpr:
+      return m_pass->visit(static_cast<const NumberExpr &>(expr));
+    case AstType::VariableExpr:
+      return m_pass->visit(static_cast<const VariableExpr &>(expr));
+    case AstType::BinaryExpr:
+      return m_pass->visit(static_cast<const BinaryExpr &>(expr));
+    default:
+      return m_pass->visit(static_cast<const CallExpr &>(expr));
+    }
+  }
+
+  std::size_t visit(const NumberExpr &) override { return 1; }
+  std::size_t visit(const VariableExpr &) override { return 1; }
+  std::size_t visit(const BinaryExpr &expr) override {
+    return 1 + dispatch(*expr.left()) + dispatch(*expr.right());
+  }
+  std::size_t visit(const CallExpr &expr) override {
+    std::size_t count = 1;
+    for (const auto &arg : expr.args)
+      count += dispatch(*arg);
+    return count;
+  }
+  // statements are rare next to expressions, reuse the static walk for them
+  std::size_t visit(const Stmt &stmt) override {
+    return NodeCounter().dispatch(stmt);
+  }
+};
+
+static void BM_BuildFlatAst(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  AstArena arena;
+  auto statements = Parser(TokenBuffer::scan(source), &arena).parse();
+  std::size_t bytes = 0;
+  std::size_t nodes = 0;
+
+  for (auto _ : state) {
+    FlatAst ast = FlatAst::build(statements);
+    bytes = ast.bytesUsed();
+    nodes = ast.size();
+    benchmark::DoNotOptimize(ast);
+  }
+
+  state.SetItemsProcessed(state.iterations() * nodes);
+  state.counters["bytes_per_node"] = double(bytes) / nodes;
+  state.counters["arena_bytes_per_node"] = double(arena.bytesUsed()) / nodes;
+}
+
+BENCHMARK(BM_BuildFlatAst)->Arg(1 << 20);
+
+template <typename Pass> static void countNodes(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  AstArena arena;
+  auto statements = Parser(TokenBuffer::scan(source), &arena).parse();
+
+  // the expression statements hold most of the nodes
+  std::vector<const Expr *> expressions;
+  for (const auto &statement : statements)
+    if (statement->type() == AstType::ExpressionStmt)
+      expressions.push_back(statement->as<ExpressionStmt *>()->body.get());
+    else if (statement->type() == AstType::FunctionStmt)
+      expressions.push_back(statement->as<FunctionStmt *>()
+                                ->body->returnStmt->returnValue.get());
+
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    Pass pass;
+    nodes = 0;
+    for (const Expr *expr : expressions)
+      nodes += pass.dispatch(*expr);
+    benchmark::DoNotOptimize(nodes);
+  }
+
+  state.SetItemsProcessed(state.iterations() * nodes);
+}
+
+static void BM_VisitStatic(benchmark::State &state) {
+  countNodes<NodeCounter>(state);
+}
+
+static void BM_VisitVirtual(benchmark::State &state) {
+  countNodes<VirtualNodeCounter>(state);
+}
+
+// the same count over the flat representation is a scan of the type array
+static void BM_VisitFlat(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  FlatAst ast = FlatAst::build(Parser(TokenBuffer::scan(source)).parse());
+
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    nodes = 0;
+    for (NodeId node = 0; node < ast.size(); node++) {
+      switch (ast.type(node)) {
+      case AstType::NumberExpr:
+      case AstType::VariableExpr:
+      case AstType::BinaryExpr:
+      case AstType::CallExpr:
+        nodes += 1;
+        break;
+      default:
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(nodes);
+  }
+
+  state.SetItemsProcessed(state.iterations() * ast.size());
+}
+
+BENCHMARK(BM_VisitStatic)->Arg(1 << 20);
+BENCHMARK(BM_VisitVirtual)->Arg(1 << 20);
+BENCHMARK(BM_VisitFlat)->Arg(1 << 20);
+
+// process start with a warm cache vs lexing and parsing the source again
+static void BM_ParseSource(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+
+  for (auto _ : state) {
+    AstArena arena;
+    benchmark::DoNotOptimize(Parser(source, &arena).parse());
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+// Same parse, sharing identical subexpressions. The counters show how much
+// smaller the DAG is than the tree.
+static void BM_ParseHashConsed(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  std::size_t nodes = 0;
+  std::size_t bytes = 0;
+
+  for (auto _ : state) {
+    AstArena arena;
+    Parser parser = Parser(source, &arena);
+    parser.enableHashConsing();
+    benchmark::DoNotOptimize(parser.parse());
+    nodes = arena.nodeCount();
+    bytes = arena.bytesUsed();
+  }
+
+  AstArena tree;
+  Parser(source, &tree).parse();
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+  state.counters["nodes"] = nodes;
+  state.counters["tree_nodes"] = tree.nodeCount();
+  state.counters["arena_bytes"] = bytes;
+  state.counters["tree_arena_bytes"] = tree.bytesUsed();
+}
+
+static void BM_LoadAstCache(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  std::uint64_t hash = AstCache::hashSource(source);
+  std::string data =
+      AstCache::serialize(FlatAst::build(Parser(source).parse()), hash);
+
+  for (auto _ : state) {
+    // the source still has to be hashed to validate the cache
+    benchmark::DoNotOptimize(
+        AstCache::deserialize(data, AstCache::hashSource(source)));
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+  state.counters["cache_bytes"] = data.size();
+}
+
+BENCHMARK(BM_ParseSource)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ParseHashConsed)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_LoadAstCache)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
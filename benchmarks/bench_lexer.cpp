@@ -0,0 +1,46 @@
+#include "CharScan.hpp"
+#include "Lexer.hpp"
+#include "SourceGenerator.hpp"
+
+#include <benchmark/benchmark.h>
+
+static void BM_LexGenerated(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  std::size_t count = 0;
+
+  for (auto _ : state) {
+    Lexer lexer = Lexer(source);
+    count = 0;
+    while (lexer.nextToken().m_type != TokenType::Eof)
+      count++;
+  }
+
+  state.SetLabel(charScanImplementation());
+  state.SetBytesProcessed(state.iterations() * source.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+BENCHMARK(BM_LexGenerated)->Arg(1 << 20)->Arg(16 << 20);
+
+static void BM_LexIdentifiers(benchmark::State &state) {
+  // mostly variable references with the odd keyword mixed in
+  std::string source;
+  for (std::size_t i = 0; source.size() < std::size_t(state.range(0)); i++) {
+    source += "value_" + std::to_string(i % 1000) + " x y alpha";
+    source += i % 8 == 0 ? " if then end\n" : " result\n";
+  }
+
+  std::size_t count = 0;
+
+  for (auto _ : state) {
+    Lexer lexer = Lexer(source);
+    count = 0;
+    while (lexer.nextToken().m_type != TokenType::Eof)
+      count++;
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+BENCHMARK(BM_LexIdentifiers)->Arg(1 << 20);
@@ -0,0 +1,137 @@
+#include "Compiler.hpp"
+#include "Jit.hpp"
+#include "ObjectCache.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "SourceGenerator.hpp"
+#include "ThreadPool.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <string>
+
+static const OptLevel LEVELS[] = {OptLevel::O0, OptLevel::Repl, OptLevel::O1,
+                                  OptLevel::O2, OptLevel::O3};
+static const char *const LEVEL_NAMES[] = {"O0", "Orepl", "O1", "O2", "O3"};
+
+// A tree of calls, `f<depth>` calls `f<depth - 1>` twice: 2^depth calls
+// unless the optimizer inlines and simplifies them away.
+static std::string callTree(int depth) {
+  std::string source = "def f0(x) return x * 1.5 + 2 end\n";
+  for (int i = 1; i <= depth; i++) {
+    std::string callee = "f" + std::to_string(i - 1);
+    source += "def f" + std::to_string(i) + "(x) return " + callee + "(x) + " +
+              callee + "(x * 0.5) * 1 + 0 end\n";
+  }
+  return source;
+}
+
+// Compiles the definitions in `source` into one module at `level` and hands
+// it to `jit`.
+static void compile(const std::string &source, OptLevel level, Jit &jit) {
+  AstArena arena;
+  auto statements = Parser(source, &arena).parse();
+
+  Compiler compiler;
+  compiler.setOptLevel(level, jit.targetMachine());
+  for (const auto &statement : statements)
+    if (statement->type() == AstType::FunctionStmt)
+      compiler.codegen(statement.get());
+
+  compiler.optimize();
+  jit.add(compiler.takeModule());
+}
+
+// Latency from parsed source to machine code.
+static void BM_CompileLatency(benchmark::State &state) {
+  OptLevel level = LEVELS[state.range(0)];
+  std::string source = generateSource(64 << 10);
+  Symbol first = Interner::get().intern("generated_kernel_function_0");
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto jit = Jit::create(level);
+    state.ResumeTiming();
+
+    compile(source, level, *jit);
+    // code is generated lazily, on the first lookup of a module's symbols
+    benchmark::DoNotOptimize(jit->lookup(first));
+  }
+
+  state.SetLabel(LEVEL_NAMES[state.range(0)]);
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+// Speed of the generated code.
+static void BM_GeneratedCode(benchmark::State &state) {
+  OptLevel level = LEVELS[state.range(0)];
+  constexpr int depth = 12;
+
+  auto jit = Jit::create(level);
+  compile(callTree(depth), level, *jit);
+  auto function = reinterpret_cast<double (*)(double)>(
+      jit->lookup(Interner::get().intern("f" + std::to_string(depth))));
+
+  double x = 1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(x);
+    benchmark::DoNotOptimize(function(x));
+  }
+
+  state.SetLabel(LEVEL_NAMES[state.range(0)]);
+}
+
+BENCHMARK(BM_CompileLatency)->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_GeneratedCode)->DenseRange(0, 4)->Unit(benchmark::kMicrosecond);
+
+// Definitions compiled to objects on a pool, scaling across workers.
+static void BM_CompileParallel(benchmark::State &state) {
+  std::string source = generateSource(256 << 10);
+  AstArena arena;
+  auto statements = Parser(source, &arena).parse();
+
+  auto jit = Jit::create(OptLevel::O2);
+  ThreadPool pool(state.range(0));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Compiler::compileParallel(
+        statements, pool, [&]() { return jit->createTargetMachine(); }));
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+BENCHMARK(BM_CompileParallel)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// A warm start: every shard's object comes from the cache.
+static void BM_CompileParallelCached(benchmark::State &state) {
+  std::string source = generateSource(256 << 10);
+  AstArena arena;
+  auto statements = Parser(source, &arena).parse();
+
+  auto jit = Jit::create(OptLevel::O2);
+  ThreadPool pool(1);
+
+  std::string directory = "polylang-bench-object-cache";
+  ObjectCache cache(directory);
+  ShardOptions options = {.cache = &cache};
+  auto createMachine = [&]() { return jit->createTargetMachine(); };
+  Compiler::compileParallel(statements, pool, createMachine, options);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        Compiler::compileParallel(statements, pool, createMachine, options));
+  }
+
+  std::filesystem::remove_all(directory);
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+BENCHMARK(BM_CompileParallelCached)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
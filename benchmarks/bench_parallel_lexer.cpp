@@ -0,0 +1,65 @@
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "SourceGenerator.hpp"
+#include "ThreadPool.hpp"
+#include "TokenBuffer.hpp"
+
+#include <benchmark/benchmark.h>
+
+static void BM_LexSerial(benchmark::State &state) {
+  std::string source = generateSource(64 << 20);
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(Lexer(source).scanTokens());
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+// scaling across worker counts
+static void BM_LexParallel(benchmark::State &state) {
+  std::string source = generateSource(64 << 20);
+  ThreadPool pool(state.range(0));
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(Lexer::scanTokensParallel(source, pool));
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+BENCHMARK(BM_LexSerial)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_LexParallel)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static void BM_ParseSerial(benchmark::State &state) {
+  std::string source = generateSource(16 << 20);
+  TokenBuffer tokens = TokenBuffer::scan(source);
+
+  for (auto _ : state) {
+    AstArena arena;
+    benchmark::DoNotOptimize(Parser(tokens, &arena).parse());
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+// scaling across worker counts
+static void BM_ParseParallel(benchmark::State &state) {
+  std::string source = generateSource(16 << 20);
+  TokenBuffer tokens = TokenBuffer::scan(source);
+  ThreadPool pool(state.range(0));
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(Parser::parseParallel(tokens, pool));
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+BENCHMARK(BM_ParseSerial)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ParseParallel)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,71 @@
+#include "IncrementalParser.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "SourceGenerator.hpp"
+#include "TokenBuffer.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+
+// a keystroke in the middle of a large buffer, full rescan vs relex
+static void BM_FullRescanAfterEdit(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  source.insert(source.size() / 2, "x");
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(Lexer(source).scanTokens());
+}
+
+static void BM_RelexAfterEdit(benchmark::State &state) {
+  std::string before = generateSource(state.range(0));
+  std::string after = before;
+  std::size_t offset = before.size() / 2;
+  after.insert(offset, "x");
+
+  std::vector<Token> original = Lexer(before).scanTokens();
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Token> tokens = original;
+    state.ResumeTiming();
+
+    Lexer::relex(tokens, SourceLoc(), after, SourceLoc(),
+                 TextEdit{offset, 0, "x"});
+    benchmark::DoNotOptimize(tokens.data());
+  }
+}
+
+BENCHMARK(BM_FullRescanAfterEdit)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RelexAfterEdit)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+
+// the same keystroke, parsing everything again vs reusing unchanged functions
+static void BM_FullReparseAfterEdit(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  source.insert(source.size() / 2, "x");
+  TokenBuffer tokens = TokenBuffer::scan(source);
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(Parser(tokens).parse());
+}
+
+static void BM_IncrementalReparseAfterEdit(benchmark::State &state) {
+  std::string before = generateSource(state.range(0));
+  std::string after = before;
+  after.insert(after.size() / 2, "x");
+
+  // every update flips between the two versions, one span changes each time
+  std::array<TokenBuffer, 2> versions = {TokenBuffer::scan(after),
+                                         TokenBuffer::scan(before)};
+  IncrementalParser parser;
+  parser.update(versions[1]);
+
+  std::size_t i = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(parser.update(versions[i++ % 2]));
+}
+
+BENCHMARK(BM_FullReparseAfterEdit)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_IncrementalReparseAfterEdit)
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMicrosecond);
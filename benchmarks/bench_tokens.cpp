@@ -0,0 +1,89 @@
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "SourceGenerator.hpp"
+#include "TokenBuffer.hpp"
+
+#include <benchmark/benchmark.h>
+
+static void BM_ScanTokenVector(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  std::size_t count = 0;
+  std::size_t bytes = 0;
+
+  for (auto _ : state) {
+    Lexer lexer = Lexer(source);
+    std::vector<Token> tokens = lexer.scanTokens();
+    count = tokens.size();
+    bytes = tokens.capacity() * sizeof(Token);
+    benchmark::DoNotOptimize(tokens.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * count);
+  state.counters["bytes_per_token"] = double(bytes) / count;
+}
+
+static void BM_ScanTokenBuffer(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  std::size_t count = 0;
+  std::size_t bytes = 0;
+
+  for (auto _ : state) {
+    TokenBuffer tokens = TokenBuffer::scan(source);
+    count = tokens.size();
+    bytes = tokens.bytesUsed();
+    benchmark::DoNotOptimize(tokens);
+  }
+
+  state.SetItemsProcessed(state.iterations() * count);
+  state.counters["bytes_per_token"] = double(bytes) / count;
+}
+
+static void BM_ParseTokenVector(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  std::vector<Token> tokens = Lexer(source).scanTokens();
+
+  for (auto _ : state) {
+    Parser parser = Parser(tokens);
+    benchmark::DoNotOptimize(parser.parse());
+  }
+
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+
+static void BM_ParseTokenBuffer(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  TokenBuffer tokens = TokenBuffer::scan(source);
+
+  for (auto _ : state) {
+    Parser parser = Parser(tokens);
+    benchmark::DoNotOptimize(parser.parse());
+  }
+
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+
+BENCHMARK(BM_ScanTokenVector)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ScanTokenBuffer)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ParseTokenVector)->Arg(1 << 20);
+BENCHMARK(BM_ParseTokenBuffer)->Arg(1 << 20);
+
+static void BM_ParseArena(benchmark::State &state) {
+  std::string source = generateSource(state.range(0));
+  TokenBuffer tokens = TokenBuffer::scan(source);
+  std::size_t nodes = 0;
+  std::size_t bytes = 0;
+
+  for (auto _ : state) {
+    AstArena arena;
+    Parser parser = Parser(tokens, &arena);
+    benchmark::DoNotOptimize(parser.parse());
+    nodes = arena.nodeCount();
+    bytes = arena.bytesUsed();
+  }
+
+  state.SetItemsProcessed(state.iterations() * tokens.size());
+  state.counters["nodes"] = nodes;
+  state.counters["arena_bytes"] = bytes;
+}
+
+BENCHMARK(BM_ParseArena)->Arg(1 << 20);
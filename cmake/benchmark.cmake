@@ -0,0 +1,21 @@
+
+find_package(benchmark QUIET)
+
+if (NOT benchmark_FOUND)
+  include(FetchContent)
+
+  set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+  set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+
+  FetchContent_Declare(
+    benchmark
+    GIT_REPOSITORY https://github.com/google/benchmark
+    GIT_TAG        v1.7.1
+  )
+  FetchContent_GetProperties(benchmark)
+
+  if (NOT benchmark_POPULATED)
+    FetchContent_Populate(benchmark)
+    add_subdirectory(${benchmark_SOURCE_DIR} ${benchmark_BINARY_DIR})
+  endif()
+endif()
@@ -1,17 +1,19 @@
 #ifndef AST_HPP
 #define AST_HPP
 
-#include "Compiler.hpp"
+#include "AstArena.hpp"
+#include "Interner.hpp"
 #include "Token.hpp"
-#include "Visitor.hpp"
-
-#include <llvm/IR/Value.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
-enum class AstType {
+enum class AstType : std::uint8_t {
   ExpressionStmt,
   NumberExpr,
   VariableExpr,
@@ -22,59 +24,68 @@ enum class AstType {
   BlockStmt,
   ReturnStmt,
   PrototypeStmt,
+  LetStmt,
+  AssignStmt,
 };
 
+struct BlockStmt;
+struct ReturnStmt;
+
+// Nodes carry their type, passes dispatch on it with `AstVisitor` (see
+// Visitor.hpp) instead of a virtual call.
 struct Expr {
-  Expr(){};
   virtual ~Expr(){};
-  virtual llvm::Value *accept(Compiler &visitor) const = 0;
 
   template <typename T> T as() { return static_cast<T>(this); };
+  template <typename T> T as() const { return static_cast<T>(this); };
+
+  AstType type() const { return m_type; }
+
+protected:
+  Expr(AstType type) : m_type(type){};
+
+  // Destroys `pending` and everything below it with a worklist, recursive
+  // destructors overflow the stack on deeply nested expressions.
+  static void destroyIteratively(std::vector<AstPtr<Expr>> pending);
+
+  static bool isLeaf(const AstPtr<Expr> &expr) {
+    return !expr || (expr->type() != AstType::BinaryExpr &&
+                     expr->type() != AstType::CallExpr);
+  }
 
-  virtual AstType type() const = 0;
+private:
+  AstType m_type;
 };
 
 struct NumberExpr : public Expr {
   double value;
 
-  NumberExpr(double value) : value(value){};
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  };
-
-  AstType type() const override { return AstType::NumberExpr; }
+  NumberExpr(double value) : Expr(AstType::NumberExpr), value(value){};
 };
 
 struct VariableExpr : public Expr {
 
+  Symbol symbol;
+  // owned by the Interner
   std::string_view name;
 
-  VariableExpr(std::string_view name) : name(name){};
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  }
-
-  AstType type() const override { return AstType::VariableExpr; }
+  VariableExpr(Symbol symbol)
+      : Expr(AstType::VariableExpr), symbol(symbol),
+        name(Interner::get().name(symbol)){};
 };
 
 struct BinaryExpr : public Expr {
 private:
-  std::unique_ptr<Expr> m_left, m_right;
+  AstPtr<Expr> m_left, m_right;
 
 public:
   TokenType operation;
-  BinaryExpr(TokenType operation, std::unique_ptr<Expr> left,
-             std::unique_ptr<Expr> right)
-      : operation(operation), m_left(std::move(left)),
-        m_right(std::move(right)){};
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  }
+  BinaryExpr(TokenType operation, AstPtr<Expr> left,
+             AstPtr<Expr> right)
+      : Expr(AstType::BinaryExpr), m_left(std::move(left)),
+        m_right(std::move(right)), operation(operation){};
 
-  AstType type() const override { return AstType::BinaryExpr; }
+  ~BinaryExpr() override;
 
   template <typename T> T left() { return static_cast<T>(m_left.get()); };
 
@@ -83,125 +94,179 @@ public:
   const Expr *left() const { return m_left.get(); }
 
   const Expr *right() const { return m_right.get(); }
+
+  // moves an operand out, for rewrites that drop this node
+  AstPtr<Expr> releaseLeft() { return std::move(m_left); }
+
+  AstPtr<Expr> releaseRight() { return std::move(m_right); }
+
+  friend Expr;
 };
 
 struct CallExpr : public Expr {
+  Symbol calleeSymbol;
   std::string_view callee;
-  std::vector<std::unique_ptr<Expr>> args;
+  std::pmr::vector<AstPtr<Expr>> args;
 
-  CallExpr(std::string_view callee, std::vector<std::unique_ptr<Expr>> args)
-      : callee(callee), args(std::move(args)){};
+  CallExpr(Symbol callee, std::pmr::vector<AstPtr<Expr>> args)
+      : Expr(AstType::CallExpr), calleeSymbol(callee),
+        callee(Interner::get().name(callee)),
+        args(std::move(args)){};
 
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
+  ~CallExpr() override;
+};
+
+inline void Expr::destroyIteratively(std::vector<AstPtr<Expr>> pending) {
+  while (!pending.empty()) {
+    AstPtr<Expr> expr = std::move(pending.back());
+    pending.pop_back();
+
+    if (isLeaf(expr))
+      continue;
+
+    // detach the children, `expr` is then destroyed without recursing
+    if (expr->type() == AstType::BinaryExpr) {
+      auto binary = expr->as<BinaryExpr *>();
+      pending.push_back(std::move(binary->m_left));
+      pending.push_back(std::move(binary->m_right));
+    } else {
+      for (auto &arg : expr->as<CallExpr *>()->args)
+        pending.push_back(std::move(arg));
+    }
   }
+}
 
-  AstType type() const override { return AstType::CallExpr; }
-};
+inline BinaryExpr::~BinaryExpr() {
+  if (isLeaf(m_left) && isLeaf(m_right))
+    return;
 
-struct Stmt {
+  std::vector<AstPtr<Expr>> pending;
+  pending.push_back(std::move(m_left));
+  pending.push_back(std::move(m_right));
+  destroyIteratively(std::move(pending));
+}
+
+inline CallExpr::~CallExpr() {
+  if (std::all_of(args.begin(), args.end(), isLeaf))
+    return;
+
+  destroyIteratively(std::vector<AstPtr<Expr>>(
+      std::make_move_iterator(args.begin()), std::make_move_iterator(args.end())));
+}
 
+struct Stmt {
   virtual ~Stmt(){};
-  virtual llvm::Value *accept(Compiler &visitor) const = 0;
 
   template <typename T> T as() { return static_cast<T>(this); };
+  template <typename T> T as() const { return static_cast<T>(this); };
+
+  AstType type() const { return m_type; }
+
+protected:
+  Stmt(AstType type) : m_type(type){};
 
-  virtual AstType type() const = 0;
+private:
+  AstType m_type;
 };
 
 struct PrototypeStmt : public Stmt {
+  Symbol symbol;
   std::string_view name;
-  std::vector<std::string_view> args;
-
-  PrototypeStmt(std::string_view name, std::vector<std::string_view> args)
-      : name(name), args(args){};
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
+  std::pmr::vector<Symbol> argSymbols;
+  std::pmr::vector<std::string_view> args;
+
+  PrototypeStmt(Symbol name, std::pmr::vector<Symbol> args)
+      : Stmt(AstType::PrototypeStmt), symbol(name),
+        name(Interner::get().name(name)),
+        argSymbols(std::move(args)), args(argSymbols.get_allocator()) {
+    this->args.reserve(argSymbols.size());
+    for (Symbol arg : argSymbols)
+      this->args.push_back(Interner::get().name(arg));
   };
-
-  AstType type() const override { return AstType::PrototypeStmt; }
 };
 
 struct FunctionStmt : public Stmt {
-  std::unique_ptr<BlockStmt> body;
-  std::unique_ptr<PrototypeStmt> proto;
-
-  FunctionStmt(std::unique_ptr<PrototypeStmt> proto,
-               std::unique_ptr<BlockStmt> body)
-      : proto(std::move(proto)), body(std::move(body)){};
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  };
+  AstPtr<BlockStmt> body;
+  AstPtr<PrototypeStmt> proto;
 
-  AstType type() const override { return AstType::FunctionStmt; }
+  FunctionStmt(AstPtr<PrototypeStmt> proto,
+               AstPtr<BlockStmt> body)
+      : Stmt(AstType::FunctionStmt), body(std::move(body)),
+        proto(std::move(proto)){};
 };
 
 struct BlockStmt : public Stmt {
 
-  std::vector<std::unique_ptr<Stmt>> statements;
-  std::unique_ptr<ReturnStmt> returnStmt;
-
-  BlockStmt(std::vector<std::unique_ptr<Stmt>> statements,
-            std::unique_ptr<ReturnStmt> returnStmt)
-      : statements(std::move(statements)), returnStmt(std::move(returnStmt)) {}
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  }
+  std::pmr::vector<AstPtr<Stmt>> statements;
+  AstPtr<ReturnStmt> returnStmt;
 
-  AstType type() const override { return AstType::BlockStmt; }
+  BlockStmt(std::pmr::vector<AstPtr<Stmt>> statements,
+            AstPtr<ReturnStmt> returnStmt)
+      : Stmt(AstType::BlockStmt), statements(std::move(statements)),
+        returnStmt(std::move(returnStmt)) {}
 };
 
 struct ReturnStmt : public Stmt {
 
-  std::unique_ptr<Expr> returnValue;
-
-  ReturnStmt(std::unique_ptr<Expr> returnValue)
-      : returnValue(std::move(returnValue)){};
-
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  }
+  AstPtr<Expr> returnValue;
 
-  AstType type() const override { return AstType::BlockStmt; }
+  ReturnStmt(AstPtr<Expr> returnValue)
+      : Stmt(AstType::ReturnStmt), returnValue(std::move(returnValue)){};
 };
 
 struct ExpressionStmt : public Stmt {
 
-  std::unique_ptr<PrototypeStmt> proto;
-  std::unique_ptr<Expr> body;
+  // shared by every expression statement, see `anonymousPrototype()`
+  AstPtr<PrototypeStmt> proto;
+  AstPtr<Expr> body;
 
-  ExpressionStmt(std::unique_ptr<Expr> body)
-      : proto(std::make_unique<PrototypeStmt>("__anon_expr",
-                                              std::vector<std::string_view>())),
-        body(std::move(body)) {}
+  ExpressionStmt(AstPtr<Expr> body)
+      : Stmt(AstType::ExpressionStmt),
+        proto(anonymousPrototype(), AstDeleter{true}), body(std::move(body)) {}
 
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
+  // `__anon_expr()`, it is the same for all expressions so it is not owned by
+  // any of them
+  static PrototypeStmt *anonymousPrototype() {
+    static PrototypeStmt proto(Interner::get().intern("__anon_expr"),
+                               std::pmr::vector<Symbol>());
+    return &proto;
   }
+};
+
+// `let name = value`, declares a mutable local of the enclosing function
+struct LetStmt : public Stmt {
+  Symbol symbol;
+  std::string_view name;
+  AstPtr<Expr> value;
 
-  AstType type() const override { return AstType::ExpressionStmt; }
+  LetStmt(Symbol symbol, AstPtr<Expr> value)
+      : Stmt(AstType::LetStmt), symbol(symbol),
+        name(Interner::get().name(symbol)), value(std::move(value)){};
 };
 
-struct IfStmt : public Stmt {
+// `name = value`, for a local or an argument
+struct AssignStmt : public Stmt {
+  Symbol symbol;
+  std::string_view name;
+  AstPtr<Expr> value;
 
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<BlockStmt> thenBlock;
-  std::unique_ptr<BlockStmt> elseBlock;
-  std::unique_ptr<Stmt> elseIf;
+  AssignStmt(Symbol symbol, AstPtr<Expr> value)
+      : Stmt(AstType::AssignStmt), symbol(symbol),
+        name(Interner::get().name(symbol)), value(std::move(value)){};
+};
 
-  llvm::Value *accept(Compiler &visitor) const override {
-    return visitor.visit(*this);
-  }
+struct IfStmt : public Stmt {
 
-  AstType type() const override { return AstType::IfStmt; }
+  AstPtr<Expr> condition;
+  AstPtr<BlockStmt> thenBlock;
+  AstPtr<BlockStmt> elseBlock;
+  AstPtr<Stmt> elseIf;
 
-  IfStmt(std::unique_ptr<Expr> condition, std::unique_ptr<BlockStmt> thenBlock,
-         std::unique_ptr<Stmt> elseIf, std::unique_ptr<BlockStmt> elseBlock)
-      : condition(std::move(condition)), thenBlock(std::move(thenBlock)),
-        elseIf(std::move(elseIf)), elseBlock(std::move(elseBlock)){};
+  IfStmt(AstPtr<Expr> condition, AstPtr<BlockStmt> thenBlock,
+         AstPtr<Stmt> elseIf, AstPtr<BlockStmt> elseBlock)
+      : Stmt(AstType::IfStmt), condition(std::move(condition)),
+        thenBlock(std::move(thenBlock)), elseBlock(std::move(elseBlock)),
+        elseIf(std::move(elseIf)){};
 };
 
 #endif // !AST_HPP
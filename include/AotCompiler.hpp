@@ -0,0 +1,57 @@
+#ifndef AOT_COMPILER_HPP
+#define AOT_COMPILER_HPP
+
+#include "AST.hpp"
+#include "Optimizer.hpp"
+
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compiles sources ahead of time into objects or shared libraries that other
+// programs link against.
+//
+// Every `def` becomes a C function `double name(double, ...)`, declared in a
+// header generated next to the output. Top level expressions have nowhere to
+// run and are left out. Code is generated for the host's CPU and features,
+// like the Jit's.
+class AotCompiler {
+public:
+  enum class Output {
+    Object,
+    // linked by the system's `cc`
+    SharedLibrary,
+  };
+
+  // Compiles the definitions among `statements` into `path` at `level`.
+  // Returns false after logging why on failure.
+  static bool compile(const std::vector<AstPtr<Stmt>> &statements,
+                      const std::string &path, Output output, OptLevel level);
+
+  // the host's target, position independent when `pic`; null after logging
+  // why on failure
+  static std::unique_ptr<llvm::TargetMachine> createHostMachine(OptLevel level,
+                                                                bool pic);
+
+  // Checks that the definitions among `statements` can be declared in C,
+  // logging every name that is a keyword or reserved. Returns false if any
+  // cannot.
+  static bool checkNames(const std::vector<AstPtr<Stmt>> &statements);
+
+  // C declarations of the definitions among `statements`, usable from C++
+  static std::string header(const std::vector<AstPtr<Stmt>> &statements,
+                            std::string_view guard);
+
+  // `path` with its extension replaced by `.h`
+  static std::string headerPathFor(const std::string &path);
+
+  // Writes the header of the definitions among `statements` for an output
+  // at `path`. Returns false on I/O errors.
+  static bool writeHeader(const std::vector<AstPtr<Stmt>> &statements,
+                          const std::string &path);
+};
+
+#endif // !AOT_COMPILER_HPP
@@ -0,0 +1,76 @@
+#ifndef AST_ARENA_HPP
+#define AST_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Deletes heap allocated AST nodes, nodes living in an AstArena are left
+// alone, the arena releases them all at once.
+struct AstDeleter {
+  bool inArena = false;
+
+  template <typename T> void operator()(T *node) const {
+    if (!inArena)
+      delete node;
+  }
+};
+
+// Owning pointer to an AST node, heap or arena allocated.
+template <typename T> using AstPtr = std::unique_ptr<T, AstDeleter>;
+
+// Bump allocator holding the AST of one compilation.
+//
+// Node destructors never run: everything a node owns (children, argument
+// lists) must be allocated from the same arena, which is what the Parser does
+// when handed one. The arena has to outlive the statements parsed into it.
+class AstArena : public std::pmr::memory_resource {
+private:
+  static constexpr std::size_t SLAB_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<std::byte[]>> m_slabs;
+  std::byte *m_cursor = nullptr;
+  std::byte *m_end = nullptr;
+
+  std::size_t m_nodeCount = 0;
+  std::size_t m_bytesUsed = 0;
+  std::size_t m_bytesReserved = 0;
+
+public:
+  AstArena() = default;
+
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+
+  template <typename T, typename... Args> AstPtr<T> create(Args &&...args) {
+    void *memory = allocate(sizeof(T), alignof(T));
+    m_nodeCount += 1;
+    return AstPtr<T>(new (memory) T(std::forward<Args>(args)...),
+                     AstDeleter{true});
+  }
+
+  // number of nodes created with `create()`
+  std::size_t nodeCount() const { return m_nodeCount; }
+
+  // bytes handed out, including argument lists and alignment padding
+  std::size_t bytesUsed() const { return m_bytesUsed; }
+
+  // bytes requested from the system
+  std::size_t bytesReserved() const { return m_bytesReserved; }
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+  // memory is only given back when the arena goes away
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+#endif // !AST_ARENA_HPP
@@ -0,0 +1,46 @@
+#ifndef AST_CACHE_HPP
+#define AST_CACHE_HPP
+
+#include "FlatAst.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Binary on-disk cache of a parsed source, stored as its FlatAst.
+//
+// A cache file is a fixed header followed by the arrays of the FlatAst, so
+// loading one is a handful of copies out of a memory mapping. Symbol ids only
+// mean something inside one process, the file carries the names and they are
+// interned again on load. A cache is only used when its format version and
+// the hash of the source it was built from both match.
+class AstCache {
+public:
+  static constexpr std::uint32_t VERSION = 2;
+
+  // `<source>.astc`, next to the source
+  static std::string pathFor(const std::string &sourcePath);
+
+  static std::uint64_t hashSource(std::string_view source);
+
+  // Writes `ast` to `path`, through a temporary file that is renamed over it
+  // so readers never see a partial cache. Returns false on I/O errors.
+  static bool write(const std::string &path, const FlatAst &ast,
+                    std::uint64_t sourceHash);
+
+  // the AST stored at `path` if it exists, is intact and was built from a
+  // source hashing to `sourceHash`
+  static std::optional<FlatAst> load(const std::string &path,
+                                     std::uint64_t sourceHash);
+
+  static std::string serialize(const FlatAst &ast, std::uint64_t sourceHash);
+  static std::optional<FlatAst> deserialize(std::string_view data,
+                                            std::uint64_t sourceHash);
+
+private:
+  // checks every index of a loaded AST before anyone follows it
+  static bool isWellFormed(const FlatAst &ast);
+};
+
+#endif // !AST_CACHE_HPP
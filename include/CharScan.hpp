@@ -0,0 +1,75 @@
+#ifndef CHAR_SCAN_HPP
+#define CHAR_SCAN_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized kernels used by the Lexer to skip over runs of characters.
+//
+// Each kernel returns a pointer to the first byte in [begin, end) that does
+// not belong to the run, or `end`. An AVX2, SSE2 or scalar implementation is
+// picked once at startup depending on what the host CPU supports.
+
+// skips ' ', '\t', '\r' and '\n'
+const char *skipWhitespace(const char *begin, const char *end);
+
+// skips [A-Za-z0-9_]
+const char *skipIdentifier(const char *begin, const char *end);
+
+// skips [0-9]
+const char *skipDigits(const char *begin, const char *end);
+
+// finds the next '\n', used to skip the body of a `//` comment
+const char *findNewline(const char *begin, const char *end);
+
+// name of the selected implementation, "avx2", "sse2" or "scalar"
+const char *charScanImplementation();
+
+enum CharClass : std::uint8_t {
+  Whitespace = 1 << 0,
+  Digit = 1 << 1,
+  Alpha = 1 << 2,
+  Underscore = 1 << 3,
+};
+
+constexpr std::array<std::uint8_t, 256> makeCharClasses() {
+  std::array<std::uint8_t, 256> classes = {};
+
+  for (char c : {' ', '\t', '\r', '\n'})
+    classes[static_cast<unsigned char>(c)] |= Whitespace;
+
+  for (char c = '0'; c <= '9'; c++)
+    classes[static_cast<unsigned char>(c)] |= Digit;
+
+  for (char c = 'a'; c <= 'z'; c++) {
+    classes[static_cast<unsigned char>(c)] |= Alpha;
+    classes[static_cast<unsigned char>(c - 'a' + 'A')] |= Alpha;
+  }
+
+  classes['_'] |= Underscore;
+  return classes;
+}
+
+inline constexpr std::array<std::uint8_t, 256> CHAR_CLASSES =
+    makeCharClasses();
+
+inline bool hasCharClass(char c, std::uint8_t mask) {
+  return CHAR_CLASSES[static_cast<unsigned char>(c)] & mask;
+}
+
+inline bool isWhitespace(char c) { return hasCharClass(c, Whitespace); }
+
+inline bool isDigit(char c) { return hasCharClass(c, Digit); }
+
+inline bool isAlpha(char c) { return hasCharClass(c, Alpha); }
+
+inline bool isIdentifierStart(char c) {
+  return hasCharClass(c, Alpha | Underscore);
+}
+
+inline bool isIdentifierChar(char c) {
+  return hasCharClass(c, Alpha | Digit | Underscore);
+}
+
+#endif // !CHAR_SCAN_HPP
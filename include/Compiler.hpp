@@ -2,22 +2,63 @@
 #ifndef COMPILER_HPP
 #define COMPILER_HPP
 
+#include "FlatAst.hpp"
+#include "Interner.hpp"
+#include "ObjectCache.hpp"
+#include "Optimizer.hpp"
+#include "SymbolTable.hpp"
 #include "Visitor.hpp"
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/Value.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Target/TargetMachine.h>
 
-#include <map>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 class PolyLang;
+class ThreadPool;
+
+// Definitions compiled by `Compiler::compileParallel()`.
+struct CompiledShards {
+  // one relocatable object per shard, in source order
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects;
+  // each shard's optimized IR when asked for
+  std::vector<std::string> ir;
+  // definitions that failed to compile and were left out
+  std::size_t failures = 0;
+  // objects that came from the cache rather than being compiled
+  std::size_t cached = 0;
+};
+
+// How `Compiler::compileParallel()` splits and compiles definitions.
+struct ShardOptions {
+  OptLevel level = OptLevel::O2;
+  // number of shards, 0 for four per worker
+  std::size_t shards = 0;
+  // keep each shard's IR, optimized unless its object came from the cache
+  bool keepIR = false;
+  // objects are looked up here before optimizing and compiling a shard
+  ObjectCache *cache = nullptr;
+  // false to compile every shard and overwrite what the cache holds, e.g.
+  // when its objects failed to load
+  bool readCache = true;
+};
 
-class Compiler : public ExprVisitor<llvm::Value *>,
-                 public StmtVisitor<llvm::Function *, llvm::Value *> {
+class Compiler : public AstVisitor<Compiler, llvm::Value *> {
 
   using Value = llvm::Value;
   using Function = llvm::Function;
@@ -26,7 +67,29 @@ private:
   std::unique_ptr<llvm::LLVMContext> m_context;
   std::unique_ptr<llvm::IRBuilder<>> m_builder;
   std::unique_ptr<llvm::Module> m_module;
-  std::map<std::string_view, llvm::Value *> m_namedValues;
+  // Names are resolved by symbol id, not by string. Arguments are bound to
+  // their value until assigned to, locals and assigned arguments to an
+  // entry block `alloca` that the optimizer promotes back to registers.
+  SymbolTable<llvm::Value *> m_namedValues;
+  // functions of the current module
+  SymbolTable<llvm::Function *> m_functions;
+  // arity of every function compiled so far, in any module
+  SymbolTable<std::optional<std::size_t>> m_arities;
+  // worklist of `codegen(const Expr *)`, a node is expanded once its
+  // operands are queued
+  std::vector<std::pair<const Expr *, bool>> m_exprWork;
+  std::vector<llvm::Value *> m_exprValues;
+  // Values of the binary expressions and calls emitted in the current
+  // function. Hash-consed ASTs share identical subtrees, these are emitted
+  // once and reused. Function bodies are a single block, so an earlier value
+  // always dominates its reuse. Assignments make them stale, they clear it.
+  llvm::DenseMap<const Expr *, llvm::Value *> m_sharedValues;
+  // values of the subtree being lowered by `codegenFlat()`
+  std::vector<llvm::Value *> m_flatValues;
+  // null at -O0
+  std::unique_ptr<Optimizer> m_optimizer;
+  // target of the modules, null for the default one
+  llvm::TargetMachine *m_machine = nullptr;
 
 public:
   Compiler() { initializeModuleAndPassManager(); };
@@ -35,23 +98,96 @@ public:
     m_context = std::make_unique<llvm::LLVMContext>();
     m_module = std::make_unique<llvm::Module>("__PolyLangMain", *m_context);
     m_builder = std::make_unique<llvm::IRBuilder<>>(*m_context);
+
+    if (m_machine) {
+      m_module->setDataLayout(m_machine->createDataLayout());
+      m_module->setTargetTriple(m_machine->getTargetTriple().str());
+    }
   };
 
+  // Optimizes at `level` from now on. Modules target `machine` when there is
+  // one, which has to outlive the compiler. Nothing is optimized by default.
+  void setOptLevel(OptLevel level, llvm::TargetMachine *machine = nullptr);
+
+  // Records that `name` takes `arity` arguments, so calls to it compile
+  // without its definition being compiled here.
+  void predeclare(Symbol name, std::size_t arity) {
+    m_arities.insert(name, arity);
+  }
+
+  // the current module as a relocatable object for the target machine, null
+  // after logging why when there is none or it cannot emit objects
+  std::unique_ptr<llvm::MemoryBuffer> emitObject();
+
+  // Compiles the function definitions among `statements` on `pool`.
+  //
+  // Consecutive definitions are split into shards, each compiled by a
+  // Compiler with a context, module and target machine of its own, then
+  // optimized and turned into an object on the same worker. Shards call
+  // each other through declarations, so the objects are meant to be loaded
+  // into a Jit or linked together. Other statements are left out.
+  static CompiledShards compileParallel(
+      const std::vector<AstPtr<Stmt>> &statements, ThreadPool &pool,
+      const std::function<std::unique_ptr<llvm::TargetMachine>()>
+          &createMachine,
+      const ShardOptions &options = {});
+
+  // runs the optimizer over the current module
+  void optimize() {
+    if (m_optimizer)
+      m_optimizer->run(*m_module);
+  }
+
   Value *codegen(const Expr *const expr);
   Value *codegen(const Stmt *const stmt);
 
-  Value *visit(const NumberExpr &expr) override;
-  Value *visit(const VariableExpr &expr) override;
-  Value *visit(const BinaryExpr &expr) override;
-  Value *visit(const CallExpr &expr) override;
+  // lowers `node` of a flat AST, same results as the pointer AST overloads
+  Value *codegen(const FlatAst &ast, NodeId node);
+
+  const llvm::Module &module() const { return *m_module; }
 
-  Function *visit(const FunctionStmt &stmt) override;
-  Function *visit(const IfStmt &stmt) override;
-  Function *visit(const PrototypeStmt &stmt) override;
-  Function *visit(const BlockStmt &stmt) override;
+  // The function in the current module. One that was compiled into an earlier
+  // module is declared in this one on first use.
+  Function *getFunction(Symbol name);
 
-  Value *visit(const ExpressionStmt &stmt) override;
-  Value *visit(const ReturnStmt &stmt) override;
+  // Hands over the module compiled so far along with its context, e.g. to
+  // the Jit, and starts an empty one.
+  llvm::orc::ThreadSafeModule takeModule();
+
+  // removes a function from the module, e.g. a `__anon_expr` once it ran
+  void eraseFunction(Symbol name);
+
+  Value *visit(const NumberExpr &expr);
+  Value *visit(const VariableExpr &expr);
+  Value *visit(const BinaryExpr &expr);
+  Value *visit(const CallExpr &expr);
+
+  Function *visit(const FunctionStmt &stmt);
+  Function *visit(const IfStmt &stmt);
+  Function *visit(const PrototypeStmt &stmt);
+  Function *visit(const BlockStmt &stmt);
+
+  Value *visit(const ExpressionStmt &stmt);
+  Value *visit(const ReturnStmt &stmt);
+  Value *visit(const LetStmt &stmt);
+  Value *visit(const AssignStmt &stmt);
+
+private:
+  // expressions of a flat AST are lowered in one scan over their subtree
+  Value *codegenFlat(const FlatAst &ast, NodeId root);
+  Function *codegenFlatFunction(const FlatAst &ast, NodeId node);
+  Function *codegenFlatExpressionStmt(const FlatAst &ast, NodeId node);
+
+  Value *emitVariable(Symbol name);
+  Value *emitLet(Symbol name, Value *value);
+  Value *emitAssign(Symbol name, Value *value);
+  // a stack slot for `name` at the start of the current function
+  llvm::AllocaInst *createSlot(Symbol name);
+
+  Value *emitBinary(TokenType operation, Value *L, Value *R);
+  Value *emitCall(Symbol callee, llvm::ArrayRef<Value *> args);
+  Function *emitPrototype(Symbol name, llvm::ArrayRef<Symbol> args);
+  Function *declare(Symbol name, std::size_t arity);
 
   friend PolyLang;
 };
@@ -0,0 +1,51 @@
+#ifndef CONSTANT_FOLDER_HPP
+#define CONSTANT_FOLDER_HPP
+
+#include "AST.hpp"
+#include "Token.hpp"
+
+#include <optional>
+
+// Simplifies binary expressions while the parser builds them, children first,
+// so literal arithmetic never reaches the IR builder.
+//
+// By default only rewrites that give the same result under IEEE 754 are made:
+// operations on two numbers, `x * 1`, `1 * x`, `x / 1` and `x - 0`. With
+// `fastMath`, the ones that can change the sign of a zero, a NaN or the
+// rounding are made too: `x + 0`, `0 + x`, `x * 0`, `0 * x` and reassociating
+// `(x + a) + b` into `x + (a + b)`, and likewise for `*`.
+class ConstantFolder {
+public:
+  // What `left operation right` simplifies to.
+  struct Fold {
+    enum class Kind {
+      // nothing to simplify
+      Keep,
+      // the number `value`
+      Number,
+      // one of the operands
+      Left,
+      Right,
+      // the non-number operand of `left`, combined with the number `value`
+      Reassociate,
+    };
+
+    Kind kind = Kind::Keep;
+    double value = 0;
+  };
+
+private:
+  bool m_fastMath;
+
+public:
+  explicit ConstantFolder(bool fastMath = false) : m_fastMath(fastMath){};
+
+  Fold fold(TokenType operation, const Expr *left, const Expr *right) const;
+
+  // `left operation right` as the compiler would compute it, comparisons give
+  // 1 or 0
+  static std::optional<double> evaluate(TokenType operation, double left,
+                                        double right);
+};
+
+#endif // !CONSTANT_FOLDER_HPP
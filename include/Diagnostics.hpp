@@ -0,0 +1,39 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include "Error.hpp"
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Collects the errors found while lexing and parsing a source.
+//
+// Errors are recorded instead of thrown so the lexer and the parser can keep
+// going and report everything that is wrong with a file in a single pass.
+class Diagnostics {
+private:
+  std::vector<Error> m_errors;
+
+public:
+  void report(Error error) { m_errors.push_back(error); }
+
+  void append(const Diagnostics &other) {
+    m_errors.insert(m_errors.end(), other.m_errors.begin(),
+                    other.m_errors.end());
+  }
+
+  bool hasErrors() const { return !m_errors.empty(); }
+
+  std::size_t count() const { return m_errors.size(); }
+
+  const std::vector<Error> &errors() const { return m_errors; }
+
+  void clear() { m_errors.clear(); }
+
+  // prints every error along with the offending source line, locations are
+  // resolved through the SourceManager
+  void print(std::ostream &out) const;
+};
+
+#endif // !DIAGNOSTICS_HPP
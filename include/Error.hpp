@@ -11,11 +11,11 @@ struct Error {
   std::string_view m_message;
   std::optional<std::string_view> m_tip;
   std::optional<FileLoc> m_fileLoc;
-  std::optional<LineLoc> m_lineLoc;
+  std::optional<SourceRange> m_range;
 
   Error(std::string_view message)
       : m_message(message), m_tip(std::nullopt), m_fileLoc(std::nullopt),
-        m_lineLoc(std::nullopt) {}
+        m_range(std::nullopt) {}
 
   Error &setTip(std::string_view tip) {
     m_tip = tip;
@@ -23,16 +23,16 @@ struct Error {
   }
 
   Error &setFileLoc(FileLoc fileLoc) {
-    assert(!m_lineLoc.has_value());
+    assert(!m_range.has_value());
 
     m_fileLoc = fileLoc;
     return *this;
   }
 
-  Error &setLineLoc(std::size_t start, std::size_t end, std::size_t line) {
+  Error &setRange(SourceRange range) {
     assert(!m_fileLoc.has_value());
 
-    m_lineLoc = LineLoc(start, end, line);
+    m_range = range;
     return *this;
   }
 };
@@ -0,0 +1,108 @@
+#ifndef FLAT_AST_HPP
+#define FLAT_AST_HPP
+
+#include "AstArena.hpp"
+#include "Interner.hpp"
+#include "Token.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+enum class AstType : std::uint8_t;
+struct Expr;
+struct Stmt;
+
+// Index of a node in a FlatAst.
+typedef std::uint32_t NodeId;
+
+constexpr NodeId NO_NODE = std::numeric_limits<NodeId>::max();
+
+// The AST as a handful of contiguous arrays instead of linked nodes.
+//
+// Nodes are stored in post-order: children come before their parent and every
+// subtree is the contiguous range `[subtreeStart(id), id]`, so bottom-up passes
+// are a single forward scan. Each node has up to four 32-bit operands, what
+// they hold depends on its type:
+//
+//   NumberExpr      index into the number table
+//   VariableExpr    symbol
+//   BinaryExpr      left, right, operator
+//   CallExpr        callee symbol, list of argument nodes
+//   PrototypeStmt   symbol, list of argument symbols
+//   FunctionStmt    prototype, body
+//   BlockStmt       list of statement nodes, return or NO_NODE
+//   ReturnStmt      value or NO_NODE
+//   ExpressionStmt  body
+//   IfStmt          condition, then block, else if or NO_NODE, else block or
+//                   NO_NODE
+//   LetStmt         symbol, value
+//   AssignStmt      symbol, value
+//
+// A list takes two operands, its begin and length in the shared list table.
+class FlatAst {
+public:
+  typedef std::array<std::uint32_t, 4> Operands;
+
+private:
+  std::vector<AstType> m_types;
+  std::vector<NodeId> m_subtreeStarts;
+  std::vector<Operands> m_operands;
+
+  std::vector<double> m_numbers;
+  std::vector<std::uint32_t> m_lists;
+
+  // top level statements in source order
+  std::vector<NodeId> m_roots;
+
+public:
+  static FlatAst build(const std::vector<AstPtr<Stmt>> &statements);
+
+  std::size_t size() const { return m_types.size(); }
+
+  std::span<const NodeId> roots() const { return m_roots; }
+
+  AstType type(NodeId node) const { return m_types[node]; }
+
+  NodeId subtreeStart(NodeId node) const { return m_subtreeStarts[node]; }
+
+  const Operands &operands(NodeId node) const { return m_operands[node]; }
+
+  // value of a NumberExpr
+  double number(NodeId node) const { return m_numbers[m_operands[node][0]]; }
+
+  // symbol of a VariableExpr, CallExpr, PrototypeStmt, LetStmt or AssignStmt
+  Symbol symbol(NodeId node) const { return Symbol{m_operands[node][0]}; }
+
+  TokenType operation(NodeId node) const {
+    return static_cast<TokenType>(m_operands[node][2]);
+  }
+
+  // arguments of a CallExpr or PrototypeStmt, statements of a BlockStmt
+  std::span<const std::uint32_t> list(NodeId node) const;
+
+  // Hash of the whole tree. Symbols are hashed by id, so it is only stable
+  // within one process.
+  std::uint64_t hash() const;
+
+  // bytes held by the arrays
+  std::size_t bytesUsed() const;
+
+  bool operator==(const FlatAst &other) const = default;
+
+  friend class AstCache;
+
+private:
+  NodeId add(const Expr *expr);
+  NodeId add(const Stmt *stmt);
+
+  NodeId push(AstType type, NodeId subtreeStart, Operands operands);
+
+  // appends a list, returns its begin
+  std::uint32_t pushList(std::span<const std::uint32_t> items);
+};
+
+#endif // !FLAT_AST_HPP
@@ -0,0 +1,50 @@
+#ifndef HASH_CONS_HPP
+#define HASH_CONS_HPP
+
+#include "AST.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+
+// Fields of an expression that is about to be built. `value` holds the bits
+// of a number or the id of a symbol.
+struct ExprKey {
+  AstType type;
+  TokenType operation;
+  std::uint64_t value;
+  std::span<const Expr *const> children;
+};
+
+// Expressions built so far, for sharing structurally identical ones.
+//
+// Children are looked up before their parents, so two expressions are
+// identical when their own fields and the addresses of their children are.
+// All PolyLang expressions are pure, calls included, which makes any two
+// identical expressions interchangeable.
+class HashConsTable {
+private:
+  std::unordered_multimap<std::size_t, Expr *> m_nodes;
+  std::size_t m_hits = 0;
+
+public:
+  // the expression identical to `key`, nullptr when there is none yet
+  Expr *find(const ExprKey &key);
+
+  void insert(const ExprKey &key, Expr *expr) {
+    m_nodes.emplace(hash(key), expr);
+  }
+
+  // number of distinct expressions
+  std::size_t size() const { return m_nodes.size(); }
+
+  // number of expressions that were found instead of built
+  std::size_t hits() const { return m_hits; }
+
+private:
+  static std::size_t hash(const ExprKey &key);
+  static bool matches(const ExprKey &key, const Expr *expr);
+};
+
+#endif // !HASH_CONS_HPP
@@ -0,0 +1,59 @@
+#ifndef INCREMENTAL_PARSER_HPP
+#define INCREMENTAL_PARSER_HPP
+
+#include "AST.hpp"
+#include "Diagnostics.hpp"
+#include "TokenBuffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Keeps the AST of a source that is edited over time.
+//
+// The tokens are split into top level spans the way `Parser::parseParallel`
+// splits them, one per `def`/`if` along with the expression statements after
+// it. A span is fingerprinted by its text, not by its location, so a span
+// that only moved keeps its AST. Spans that had errors
+// are always parsed again to get their diagnostics at the right place.
+class IncrementalParser {
+public:
+  struct Update {
+    // indices into `statements()` of the statements that were parsed again,
+    // everything else is the same object as before the update
+    std::vector<std::size_t> changed;
+    // number of statements dropped along with the spans they were in
+    std::size_t removed = 0;
+    std::size_t reusedSpans = 0;
+    std::size_t parsedSpans = 0;
+  };
+
+private:
+  struct Span {
+    std::uint64_t fingerprint;
+    std::vector<AstPtr<Stmt>> statements;
+    Diagnostics diagnostics;
+  };
+
+  std::vector<Span> m_spans;
+  std::vector<const Stmt *> m_statements;
+  Diagnostics m_diagnostics;
+
+public:
+  // Brings the AST up to date with `tokens`, the complete token stream of the
+  // new version of the source. `tokens` is only needed during the call.
+  Update update(const TokenBuffer &tokens);
+
+  // every top level statement of the source, in source order
+  const std::vector<const Stmt *> &statements() const { return m_statements; }
+
+  const Diagnostics &diagnostics() const { return m_diagnostics; }
+
+  std::size_t spanCount() const { return m_spans.size(); }
+
+private:
+  static std::uint64_t fingerprint(const TokenBuffer &tokens, std::size_t begin,
+                                   std::size_t end);
+};
+
+#endif // !INCREMENTAL_PARSER_HPP
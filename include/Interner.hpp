@@ -0,0 +1,40 @@
+#ifndef INTERNER_HPP
+#define INTERNER_HPP
+
+#include <llvm/ADT/StringMap.h>
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// Stable 32-bit id of an interned name. Ids are dense, starting at 0.
+struct Symbol {
+  std::uint32_t id;
+
+  constexpr bool operator==(const Symbol &other) const = default;
+};
+
+// Maps every distinct name to a Symbol and owns the characters.
+//
+// Names handed out by `name()` stay valid for the lifetime of the process, so
+// the AST can keep them after the source text (e.g. a REPL line) is gone.
+// Interning is thread safe.
+class Interner {
+private:
+  mutable std::shared_mutex m_mutex;
+  llvm::StringMap<Symbol> m_symbols;
+  std::vector<std::string_view> m_names;
+
+public:
+  static Interner &get();
+
+  Symbol intern(std::string_view name);
+
+  std::string_view name(Symbol symbol) const;
+
+  // number of symbols handed out so far
+  std::size_t size() const;
+};
+
+#endif // !INTERNER_HPP
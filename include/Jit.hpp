@@ -0,0 +1,76 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "Interner.hpp"
+#include "ObjectCache.hpp"
+#include "Optimizer.hpp"
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Runs compiled modules in process with ORC's LLJIT, generating code for the
+// CPU it runs on, features included.
+//
+// Definitions are added once and stay, later modules call them through
+// declarations (see `Compiler::getFunction()`). Top level expressions are
+// added, run and removed again, so every one can reuse the same name.
+class Jit {
+private:
+  // adapts the ObjectCache for the compile layer, which refers to it
+  std::unique_ptr<llvm::ObjectCache> m_objectCache;
+  std::unique_ptr<llvm::orc::LLJIT> m_jit;
+  llvm::orc::JITTargetMachineBuilder m_machineBuilder;
+  // same target as the JIT's, for the optimizer's cost model
+  std::unique_ptr<llvm::TargetMachine> m_machine;
+
+  Jit(std::unique_ptr<llvm::ObjectCache> objectCache,
+      std::unique_ptr<llvm::orc::LLJIT> jit,
+      llvm::orc::JITTargetMachineBuilder machineBuilder,
+      std::unique_ptr<llvm::TargetMachine> machine)
+      : m_objectCache(std::move(objectCache)), m_jit(std::move(jit)),
+        m_machineBuilder(std::move(machineBuilder)),
+        m_machine(std::move(machine)){};
+
+public:
+  // Null, after logging why, when the host cannot be targeted. The backend
+  // optimizes as much as `level` asks for. Modules added as IR are looked up
+  // in `cache`, when given, before being compiled.
+  static std::unique_ptr<Jit> create(OptLevel level = OptLevel::O2,
+                                     ObjectCache *cache = nullptr);
+
+  llvm::TargetMachine *targetMachine() const { return m_machine.get(); }
+
+  // Another target machine like `targetMachine()`, e.g. for a thread of its
+  // own. Null after logging why on failure.
+  std::unique_ptr<llvm::TargetMachine> createTargetMachine() const;
+
+  // adds the definitions in `module`, returns false on errors like a
+  // function being defined twice
+  bool add(llvm::orc::ThreadSafeModule module);
+
+  // address of the function `name`, compiling it if need be, null after
+  // logging why when it was never added
+  void *lookup(Symbol name);
+
+  // adds a relocatable object, e.g. from `Compiler::compileParallel()`
+  bool addObject(std::unique_ptr<llvm::MemoryBuffer> object);
+
+  // Adds all of `objects` or, when one fails to load, none of them.
+  bool addObjects(std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects);
+
+  // runs the function `name`, taking no arguments, of `module` and returns
+  // its result, the module is dropped afterwards
+  std::optional<double> evaluate(llvm::orc::ThreadSafeModule module,
+                                 Symbol name);
+
+private:
+  void prepare(llvm::orc::ThreadSafeModule &module);
+};
+
+#endif // !JIT_HPP
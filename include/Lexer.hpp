@@ -1,38 +1,108 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
+#include "Diagnostics.hpp"
 #include "Location.hpp"
+#include "SourceManager.hpp"
+#include "ThreadPool.hpp"
 #include "Token.hpp"
 #include <cstddef>
 #include <optional>
 #include <string>
 #include <vector>
 
+// A single text replacement, offsets are relative to the start of the
+// source that was edited.
+struct TextEdit {
+  std::size_t offset;
+  std::size_t removed;
+  std::string_view inserted;
+};
+
 class Lexer {
 
 private:
   std::size_t m_start;
   std::size_t m_current;
-  std::size_t m_line;
   std::string_view m_source;
+  // location of the first character of `m_source`
+  SourceLoc m_base;
+  // errors go to the caller's sink when one is given
+  Diagnostics *m_diagnostics;
+  Diagnostics m_ownDiagnostics;
+  // set when the source ended inside a string literal
+  bool m_unterminatedString = false;
 
 public:
-  Lexer(std::string_view source)
-      : m_source(source), m_current(0), m_start(0), m_line(1) {}
+  Lexer(std::string_view source, Diagnostics *diagnostics = nullptr,
+        SourceLoc base = SourceLoc())
+      : m_source(source), m_current(0), m_start(0), m_base(base),
+        m_diagnostics(diagnostics) {}
+
+  Lexer(const SourceBuffer &buffer, Diagnostics *diagnostics = nullptr)
+      : Lexer(buffer.contents(), diagnostics, buffer.base()) {}
+
+  Diagnostics &diagnostics() {
+    return m_diagnostics ? *m_diagnostics : m_ownDiagnostics;
+  }
 
   std::vector<Token> scanTokens();
 
+  // Scans and returns the next token, skipping whitespace and comments. Once
+  // the source is exhausted every call returns an `Eof` token.
+  Token nextToken();
+
+  bool endedInsideString() const { return m_unterminatedString; }
+
+  static constexpr std::size_t DefaultChunkSize = 1 << 20;
+
+  // Lexes `source` in chunks of about `chunkSize` bytes on `pool` and
+  // returns the same tokens and errors as `scanTokens`. Chunks are split
+  // right after a newline; a chunk that turns out to start inside a string
+  // literal is merged into its predecessor and lexed again.
+  static std::vector<Token>
+  scanTokensParallel(std::string_view source, ThreadPool &pool,
+                     Diagnostics *diagnostics = nullptr,
+                     SourceLoc base = SourceLoc(),
+                     std::size_t chunkSize = DefaultChunkSize);
+
+  // Brings `tokens`, scanned from a source starting at `previousBase`, up to
+  // date with `source` which is that text after applying `edit`. Lexing
+  // restarts a token before the edit and stops as soon as a new token starts
+  // where a token after the edit used to; the remaining tokens are only
+  // shifted. Only errors in the rescanned region are reported.
+  static void relex(std::vector<Token> &tokens, SourceLoc previousBase,
+                    std::string_view source, SourceLoc base,
+                    const TextEdit &edit, Diagnostics *diagnostics = nullptr);
+
+  static void relex(std::vector<Token> &tokens, const SourceBuffer &previous,
+                    const SourceBuffer &buffer, const TextEdit &edit,
+                    Diagnostics *diagnostics = nullptr) {
+    relex(tokens, previous.base(), buffer.contents(), buffer.base(), edit,
+          diagnostics);
+  }
+
+  static std::vector<Token>
+  scanTokensParallel(const SourceBuffer &buffer, ThreadPool &pool,
+                     Diagnostics *diagnostics = nullptr,
+                     std::size_t chunkSize = DefaultChunkSize) {
+    return scanTokensParallel(buffer.contents(), pool, diagnostics,
+                              buffer.base(), chunkSize);
+  }
+
 private:
   std::optional<Token> scanSingleToken();
   Token scanIdentifier();
-  Token scanString();
+  std::optional<Token> scanString();
   Token scanNumber();
 
   // Helper Methods are defined here
   bool isFinished() { return m_current >= m_source.length(); }
 
-  LineLoc computeLineLocation() {
-    return LineLoc(m_start, m_current - 1, m_line);
+  SourceRange computeRange() { return rangeOf(m_start, m_current); }
+
+  SourceRange rangeOf(std::size_t start, std::size_t end) {
+    return SourceRange(m_base + start, m_base + end);
   }
 
   char advance() {
@@ -59,10 +129,18 @@ private:
   }
 
   char peekNext() {
-    if (isFinished())
+    if (m_current + 1 >= m_source.length())
       return '\0';
     return m_source[m_current + 1];
   }
+
+  const char *cursor() { return m_source.data() + m_current; }
+
+  const char *sourceEnd() { return m_source.data() + m_source.length(); }
+
+  void jumpTo(const char *position) {
+    m_current = position - m_source.data();
+  }
 };
 
 #endif // !LEXER_HPP
@@ -1,21 +1,42 @@
 #ifndef LOCATION_HPP
 #define LOCATION_HPP
 
-#include <cstddef>
+#include <cstdint>
 #include <vector>
 
-struct LineLoc {
-  // starting position at the line
-  std::size_t start;
-  // ending position at the line
-  std::size_t end;
-  // line number
-  std::size_t line;
+// Offset into the global source space handed out by the SourceManager. Every
+// loaded buffer owns a disjoint slice of it, offset 0 is never handed out and
+// marks an invalid location.
+struct SourceLoc {
+  std::uint32_t offset;
 
-  LineLoc(std::size_t start, std::size_t end, std::size_t line)
-      : start(start), end(end), line(line) {}
+  constexpr SourceLoc() : offset(0) {}
+  constexpr explicit SourceLoc(std::uint32_t offset) : offset(offset) {}
+
+  constexpr bool isValid() const { return offset != 0; }
+
+  constexpr SourceLoc operator+(std::uint32_t distance) const {
+    return SourceLoc(offset + distance);
+  }
+
+  constexpr bool operator==(const SourceLoc &other) const = default;
+  constexpr auto operator<=>(const SourceLoc &other) const = default;
+};
+
+// half open range [begin, end)
+struct SourceRange {
+  SourceLoc begin;
+  SourceLoc end;
+
+  constexpr SourceRange() = default;
+  constexpr SourceRange(SourceLoc begin, SourceLoc end)
+      : begin(begin), end(end) {}
+
+  constexpr std::uint32_t length() const { return end.offset - begin.offset; }
+
+  constexpr bool operator==(const SourceRange &other) const = default;
 };
 
-typedef std::vector<LineLoc> FileLoc;
+typedef std::vector<SourceRange> FileLoc;
 
-#endif // !FILELOC_HPP
+#endif // !LOCATION_HPP
@@ -0,0 +1,73 @@
+#ifndef OBJECT_CACHE_HPP
+#define OBJECT_CACHE_HPP
+
+#include "Optimizer.hpp"
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Compiled objects stored in a directory, e.g. to skip code generation on
+// the next start of a process.
+//
+// An object is stored under a key hashing the IR it was compiled from along
+// with everything else that went into it, see `key()` and `describe()`.
+// Several processes may share the directory: objects are written to a
+// temporary file, synced and renamed into place, so readers see whole files
+// or none. Files that do not parse as objects anyway, e.g. after a crash, are
+// removed on lookup. Once the directory holds more than `maxBytes`, the least
+// recently used objects are removed. A process losing a race for a file just
+// compiles again.
+class ObjectCache {
+public:
+  // bumped whenever the compiler's output changes for the same IR
+  static constexpr std::uint32_t VERSION = 1;
+
+private:
+  std::string m_directory;
+  std::uint64_t m_maxBytes;
+
+  std::atomic<std::size_t> m_hits = 0;
+  std::atomic<std::size_t> m_misses = 0;
+
+public:
+  // creates `directory` if need be
+  explicit ObjectCache(std::string directory,
+                       std::uint64_t maxBytes = 256 << 20);
+
+  // The key of `module` compiled the way `salt` says, e.g. `describe()` plus
+  // whether the module still gets optimized.
+  static std::uint64_t key(const llvm::Module &module, std::string_view salt);
+
+  // the target, CPU features and optimization level of `machine`
+  static std::string describe(const llvm::TargetMachine &machine,
+                              OptLevel level);
+
+  // the object stored under `key`, null when there is none or it is damaged
+  std::unique_ptr<llvm::MemoryBuffer> lookup(std::uint64_t key);
+
+  // Stores `object` under `key`, then evicts objects if the directory is
+  // over its budget. Returns false on I/O errors.
+  bool store(std::uint64_t key, llvm::MemoryBufferRef object);
+
+  // Removes the least recently used objects until at most `maxBytes` remain,
+  // along with temporary files left behind by writers that died.
+  void evict();
+
+  const std::string &directory() const { return m_directory; }
+
+  std::size_t hits() const { return m_hits; }
+
+  std::size_t misses() const { return m_misses; }
+
+private:
+  std::string pathFor(std::uint64_t key) const;
+};
+
+#endif // !OBJECT_CACHE_HPP
@@ -0,0 +1,58 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <optional>
+#include <string_view>
+
+enum class OptLevel {
+  O0,
+  O1,
+  O2,
+  O3,
+  // SROA, instcombine, reassociate, GVN and simplifycfg on each function, cheap
+  // enough to run on every REPL line
+  Repl,
+};
+
+// the level named by `-O0` to `-O3` or `-Orepl`
+std::optional<OptLevel> parseOptLevel(std::string_view flag);
+
+// how hard the backend tries at `level`
+llvm::CodeGenOpt::Level codeGenOptLevel(OptLevel level);
+
+// Runs a new pass manager pipeline over whole modules.
+//
+// `-O1` to `-O3` are LLVM's default pipelines, `-O0` runs nothing. Given the
+// target machine, passes see its cost model, e.g. which vector widths the
+// host has.
+class Optimizer {
+private:
+  OptLevel m_level;
+
+  // the analysis managers refer to it
+  llvm::PassBuilder m_passBuilder;
+  llvm::LoopAnalysisManager m_loops;
+  llvm::FunctionAnalysisManager m_functions;
+  llvm::CGSCCAnalysisManager m_sccs;
+  llvm::ModuleAnalysisManager m_modules;
+
+  llvm::ModulePassManager m_pipeline;
+
+public:
+  explicit Optimizer(OptLevel level, llvm::TargetMachine *machine = nullptr);
+
+  Optimizer(const Optimizer &) = delete;
+  Optimizer &operator=(const Optimizer &) = delete;
+
+  OptLevel level() const { return m_level; }
+
+  void run(llvm::Module &module);
+};
+
+#endif // !OPTIMIZER_HPP
@@ -2,63 +2,237 @@
 #define PARSER_HPP
 
 #include "AST.hpp"
+#include "AstArena.hpp"
+#include "ConstantFolder.hpp"
+#include "Diagnostics.hpp"
+#include "HashCons.hpp"
 #include "Lexer.hpp"
+#include "ThreadPool.hpp"
 #include "Token.hpp"
+#include "TokenStream.hpp"
 
+#include <array>
+#include <cstdint>
 #include <list>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <vector>
 
+constexpr std::array<std::int8_t, 256> makeBinaryPrecedences() {
+  std::array<std::int8_t, 256> precedences = {};
+  precedences.fill(-1);
+
+  auto set = [&](TokenType type, std::int8_t precedence) {
+    precedences[static_cast<std::uint8_t>(type)] = precedence;
+  };
+
+  for (TokenType type : {TokenType::Lesser, TokenType::Greater,
+                         TokenType::LesserEqual, TokenType::GreaterEqual,
+                         TokenType::EqualEqual, TokenType::BangEqual})
+    set(type, 10);
+
+  set(TokenType::Plus, 20);
+  set(TokenType::Minus, 20);
+  set(TokenType::Star, 40);
+  set(TokenType::Slash, 40);
+  return precedences;
+}
+
+// Precedence of every binary operator, -1 for tokens that are not one. All
+// operators are left associative.
+inline constexpr std::array<std::int8_t, 256> BINARY_PRECEDENCES =
+    makeBinaryPrecedences();
+
+constexpr int binaryPrecedence(TokenType type) {
+  return BINARY_PRECEDENCES[static_cast<std::uint8_t>(type)];
+}
+
+// Statements of a whole source along with the arenas they were allocated in.
+struct ParsedModule {
+  std::vector<std::unique_ptr<AstArena>> arenas;
+  std::vector<AstPtr<Stmt>> statements;
+  Diagnostics diagnostics;
+};
+
+// Rewrites applied to expressions as they are built.
+struct ParseOptions {
+  // share identical expressions, see `Parser::enableHashConsing()`
+  bool hashCons = false;
+  // fold constants, see `ConstantFolder`
+  bool foldConstants = false;
+  // let the folder make rewrites that are not exact under IEEE 754
+  bool fastMath = false;
+};
+
 class Parser {
 private:
-  std::vector<Token> m_tokens;
-  std::size_t m_current = 0;
-  bool hadParsingError = false;
+  Diagnostics m_diagnostics;
+  TokenStream m_tokens;
+  // number of `def`/`if` blocks whose `end` has not been reached yet
+  std::size_t m_blockDepth = 0;
+  // nodes are heap allocated when there is no arena
+  AstArena *m_arena = nullptr;
+  // set when identical expressions are shared
+  std::unique_ptr<HashConsTable> m_hashCons;
+  std::optional<ConstantFolder> m_folder;
 
-public:
-  Parser(const std::vector<Token> tokens) : m_tokens(tokens){};
-  Parser(const std::string_view source) {
-    Lexer lexer = Lexer(source);
-    m_tokens = lexer.scanTokens();
+  // an open `(` or argument list in `parseExpression()`
+  struct Group {
+    // the callee, for argument lists
+    std::optional<Symbol> callee;
+    // operators below this belong to enclosing groups
+    std::size_t operatorBase;
+    std::pmr::vector<AstPtr<Expr>> args;
   };
 
-  std::vector<std::unique_ptr<Stmt>> parse();
+  std::vector<AstPtr<Expr>> m_operands;
+  std::vector<TokenType> m_operators;
+  std::vector<Group> m_groups;
+
+public:
+  // Statements parsed with an `arena` are allocated from it and must not
+  // outlive it.
+  Parser(std::vector<Token> tokens, AstArena *arena = nullptr)
+      : m_tokens(std::move(tokens)), m_arena(arena){};
+  Parser(TokenBuffer tokens, AstArena *arena = nullptr)
+      : m_tokens(std::move(tokens)), m_arena(arena){};
+  Parser(const std::string_view source, AstArena *arena = nullptr)
+      : m_tokens(source, &m_diagnostics), m_arena(arena){};
+  Parser(const SourceBuffer &buffer, AstArena *arena = nullptr)
+      : m_tokens(buffer, &m_diagnostics), m_arena(arena){};
+  // parses tokens `[begin, end)` of a buffer that outlives the parser
+  Parser(const TokenBuffer &tokens, std::size_t begin, std::size_t end,
+         AstArena *arena = nullptr)
+      : m_tokens(tokens, begin, end), m_arena(arena){};
+
+  // the lexer reports into `m_diagnostics`, so the parser must stay put
+  Parser(const Parser &) = delete;
+  Parser &operator=(const Parser &) = delete;
+
+  // Shares structurally identical expressions between the statements parsed
+  // from here on, turning the AST into a DAG. Only for parsers with an arena:
+  // a shared node has several owners, which arena nodes can afford since
+  // nothing deletes them. Returns false, leaving hash-consing off, without
+  // an arena.
+  bool enableHashConsing();
+
+  // Simplifies binary expressions as they are built, see `ConstantFolder`.
+  void enableConstantFolding(bool fastMath = false) {
+    m_folder.emplace(fastMath);
+  }
+
+  void setOptions(const ParseOptions &options) {
+    if (options.hashCons)
+      enableHashConsing();
+    if (options.foldConstants)
+      enableConstantFolding(options.fastMath);
+  }
+
+  // null unless hash-consing
+  const HashConsTable *hashConsTable() const { return m_hashCons.get(); }
+
+  // Parses every statement in the source. Statements that fail to parse are
+  // reported to `diagnostics()` and skipped, parsing resumes at the next
+  // `def`/`if` or after the `end` of the broken block.
+  std::vector<AstPtr<Stmt>> parse();
+
+  // Parses the top level statements of `tokens` on `pool`.
+  //
+  // A pre-pass splits the tokens before every `def`/`if` that is not nested in
+  // another block, then runs of those spans holding about `chunkTokens`
+  // tokens are parsed concurrently, each into its own arena. Statements and
+  // diagnostics come out in source order. An error only derails the parse of
+  // its own span. Expressions are only shared within a chunk.
+  static ParsedModule parseParallel(const TokenBuffer &tokens, ThreadPool &pool,
+                                    std::size_t chunkTokens = 1 << 14,
+                                    const ParseOptions &options = {});
+
+  // Indices in `[begin, end)` before which a top level `def`/`if` starts, at
+  // least `minTokens` apart, along with `begin` and `end` themselves.
+  static std::vector<std::size_t> topLevelBoundaries(const TokenBuffer &tokens,
+                                                     std::size_t begin,
+                                                     std::size_t end,
+                                                     std::size_t minTokens);
+
+  const Diagnostics &diagnostics() const { return m_diagnostics; }
+
+  bool hadError() const { return m_diagnostics.hasErrors(); }
 
 private:
-  std::unique_ptr<Expr> parseExpression();
-  std::unique_ptr<Expr> parsePrimary();
-  std::unique_ptr<Expr> parseNumberExpr();
-  std::unique_ptr<Expr> parseGroupingExpr();
-  std::unique_ptr<Expr> parseBinaryExpr();
-  std::unique_ptr<Expr> parseIdentifierExpr();
-
-  std::unique_ptr<Stmt> parseStatement();
-  std::unique_ptr<Stmt> parseExpressionStmt();
-  std::unique_ptr<Stmt> parseFunctionDefinition();
-  std::unique_ptr<Stmt> parseIfStmt();
-
-  std::unique_ptr<BlockStmt> parseBlock();
-  std::unique_ptr<ReturnStmt> parseReturn();
-  std::unique_ptr<PrototypeStmt> parsePrototype();
-
-  std::unique_ptr<Expr> parseBinOpRHS(int exprPrec, std::unique_ptr<Expr> LHS);
-
-  int getTokenPrecedence() {
-    switch (peek().m_type) {
-    case TokenType::Lesser:
-    case TokenType::Greater:
-    case TokenType::LesserEqual:
-    case TokenType::GreaterEqual:
-    case TokenType::EqualEqual:
-      return 10;
-    case TokenType::Plus:
-    case TokenType::Minus:
-      return 20;
-    case TokenType::Star:
-      return 40;
-    default:
-      return -1;
-    }
+  // Parses an expression with explicit operand, operator and group stacks,
+  // nesting depth is not limited by the call stack.
+  AstPtr<Expr> parseExpression();
+
+  AstPtr<Stmt> parseStatement();
+  AstPtr<Stmt> parseExpressionStmt();
+  AstPtr<Stmt> parseFunctionDefinition();
+  AstPtr<Stmt> parseIfStmt();
+  // a statement of a block, which may also declare or assign locals
+  AstPtr<Stmt> parseBlockStatement();
+  AstPtr<Stmt> parseLetStmt();
+  AstPtr<Stmt> parseAssignStmt();
+
+  AstPtr<BlockStmt> parseBlock();
+  AstPtr<ReturnStmt> parseReturn();
+  AstPtr<PrototypeStmt> parsePrototype();
+
+  void synchronize();
+
+  template <typename T, typename... Args> AstPtr<T> make(Args &&...args) {
+    if (m_arena)
+      return m_arena->create<T>(std::forward<Args>(args)...);
+    return AstPtr<T>(new T(std::forward<Args>(args)...));
+  }
+
+  // Builds an expression with `create()`, unless hash-consing finds an
+  // identical one to return instead.
+  template <typename Create>
+  AstPtr<Expr> makeShared(const ExprKey &key, Create &&create) {
+    if (!m_hashCons)
+      return create();
+
+    if (Expr *found = m_hashCons->find(key))
+      return AstPtr<Expr>(found, AstDeleter{true});
+
+    AstPtr<Expr> expr = create();
+    m_hashCons->insert(key, expr.get());
+    return expr;
+  }
+
+  AstPtr<Expr> makeNumber(double value);
+  AstPtr<Expr> makeVariable(Symbol symbol);
+  AstPtr<Expr> makeBinary(TokenType operation, AstPtr<Expr> left,
+                          AstPtr<Expr> right);
+  AstPtr<Expr> makeCall(Symbol callee, std::pmr::vector<AstPtr<Expr>> args);
+
+  // an operand of `binary`, which is about to be dropped
+  AstPtr<Expr> takeOperand(BinaryExpr *binary, bool left);
+
+  // child lists live next to the nodes that own them
+  template <typename T> std::pmr::vector<T> makeList() {
+    if (m_arena)
+      return std::pmr::vector<T>(m_arena);
+    return std::pmr::vector<T>(std::pmr::new_delete_resource());
+  }
+
+  // reports an error at the current token
+  void error(std::string_view message) {
+    m_diagnostics.report(Error(message).setRange(peek().m_range));
+  }
+
+  Symbol intern(const Token &identifier) {
+    return Interner::get().intern(std::get<std::string_view>(
+        identifier.m_value.value()));
+  }
+
+  bool matchEnd() {
+    if (!match(TokenType::End))
+      return false;
+
+    if (m_blockDepth > 0)
+      m_blockDepth -= 1;
+    return true;
   }
 
   bool match(TokenType tokenType) {
@@ -76,18 +250,15 @@ private:
     return false;
   }
 
-  Token &advance() {
-    m_current += 1;
-    return m_tokens[m_current - 1];
-  }
+  Token &advance() { return m_tokens.advance(); }
 
-  Token &previous() { return m_tokens[m_current - 1]; }
+  Token &previous() { return m_tokens.previous(); }
 
-  Token &peek() { return m_tokens[m_current]; }
+  Token &peek() { return m_tokens.peek(); }
 
-  Token &peekNext() { return m_tokens[m_current + 1]; }
+  Token &peekNext() { return m_tokens.peekNext(); }
 
-  bool isFinished() { return m_tokens[m_current].m_type == TokenType::Eof; }
+  bool isFinished() { return peek().m_type == TokenType::Eof; }
 };
 
 #endif // !PARSER_HPP
@@ -1,13 +1,43 @@
 #ifndef POLYLANG_HPP
 #define POLYLANG_HPP
 
+#include "AST.hpp"
+#include "AotCompiler.hpp"
 #include "Compiler.hpp"
+#include "FlatAst.hpp"
+#include "Jit.hpp"
+#include "ObjectCache.hpp"
+#include "Parser.hpp"
+#include "SourceManager.hpp"
+#include "ThreadPool.hpp"
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class PolyLang {
 private:
   bool m_hadError;
+  // load and store parsed files as `AstCache` files next to them
+  bool m_useAstCache = false;
+  // write the IR of every statement compiled to stderr
+  bool m_printIR = false;
+  // identical subexpressions are shared, the compiler emits them once
+  ParseOptions m_parseOptions = {.hashCons = true, .foldConstants = true};
   Compiler m_compiler;
+  // compiled objects are reused across runs when given `--cache-dir`
+  std::optional<std::string_view> m_cacheDirectory;
+  std::unique_ptr<ObjectCache> m_objectCache;
+  // null when the host cannot be targeted, statements are then only compiled
+  std::unique_ptr<Jit> m_jit;
+  // -O2 for files and the REPL tier for the prompt unless given, set once
+  // `run()` starts
+  std::optional<OptLevel> m_optLevel;
+  // set by `--emit-object` and `--emit-library`, the file is then compiled
+  // ahead of time instead of run
+  std::optional<std::string_view> m_emitPath;
+  AotCompiler::Output m_emitOutput = AotCompiler::Output::Object;
   const int m_argc;
   const char **m_argv;
 
@@ -17,10 +47,27 @@ public:
 
   void run();
 
+  // whether anything failed, for the exit status
+  bool hadError() const { return m_hadError; }
+
 private:
   void runPrompt();
-  void execute(std::string_view source);
+  void execute(const SourceBuffer &source);
+  // Generates code for parsed statements, one after the other. Returns false
+  // after logging why at the first one that fails.
+  bool lower(const std::vector<AstPtr<Stmt>> &statements,
+             bool skipDefinitions = false);
+  // Compiles the definitions on `pool` and loads them into the JIT first,
+  // then lowers the other statements in source order.
+  bool lowerParallel(const std::vector<AstPtr<Stmt>> &statements,
+                     ThreadPool &pool);
+  bool lower(const FlatAst &ast);
+  // runs or keeps the statement just lowered, false if the JIT refused it
+  bool finish(bool isExpression);
+  void printModule();
   void runFile(std::string_view path);
+  // writes the definitions and their header to `m_emitPath`
+  void emit(const std::vector<AstPtr<Stmt>> &statements);
 };
 
 #endif // DEBUG
@@ -0,0 +1,50 @@
+#ifndef SOURCE_FILE_HPP
+#define SOURCE_FILE_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Read-only contents of a source file on disk.
+//
+// Regular files are memory-mapped so the lexer, the tokens and the AST can
+// point straight into the mapping without copying a single byte. Anything
+// that cannot be mapped (pipes, character devices, empty files) is read into
+// an owned buffer instead. Either way `contents()` stays valid for as long as
+// the SourceFile is alive.
+class SourceFile {
+private:
+  const char *m_data;
+  std::size_t m_size;
+  bool m_isMapped;
+  std::string m_buffer;
+
+public:
+  static std::optional<SourceFile> open(const std::string &path);
+
+  SourceFile(SourceFile &&other) noexcept;
+  SourceFile &operator=(SourceFile &&other) noexcept;
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  ~SourceFile();
+
+  std::string_view contents() const {
+    if (m_isMapped)
+      return std::string_view(m_data, m_size);
+    return m_buffer;
+  }
+
+  bool isMapped() const { return m_isMapped; }
+
+private:
+  SourceFile(const char *data, std::size_t size)
+      : m_data(data), m_size(size), m_isMapped(true) {}
+  SourceFile(std::string buffer)
+      : m_data(nullptr), m_size(0), m_isMapped(false),
+        m_buffer(std::move(buffer)) {}
+
+  void unmap();
+};
+
+#endif // !SOURCE_FILE_HPP
@@ -0,0 +1,101 @@
+#ifndef SOURCE_MANAGER_HPP
+#define SOURCE_MANAGER_HPP
+
+#include "Location.hpp"
+#include "SourceFile.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A source loaded into the SourceManager, either a mapped file or an owned
+// copy of some text (REPL lines).
+class SourceBuffer {
+private:
+  std::string m_name;
+  SourceLoc m_base;
+  std::optional<SourceFile> m_file;
+  std::string m_text;
+
+  // offsets of the first character of every line, built on first use
+  mutable std::once_flag m_lineStartsBuilt;
+  mutable std::vector<std::uint32_t> m_lineStarts;
+
+public:
+  SourceBuffer(std::string name, SourceLoc base, SourceFile file)
+      : m_name(std::move(name)), m_base(base), m_file(std::move(file)) {}
+  SourceBuffer(std::string name, SourceLoc base, std::string text)
+      : m_name(std::move(name)), m_base(base), m_text(std::move(text)) {}
+
+  std::string_view name() const { return m_name; }
+
+  std::string_view contents() const {
+    return m_file.has_value() ? m_file->contents() : m_text;
+  }
+
+  // location of the first character
+  SourceLoc base() const { return m_base; }
+
+  // location one past the last character, where `Eof` lives
+  SourceLoc end() const { return m_base + contents().size(); }
+
+  bool contains(SourceLoc loc) const {
+    return loc >= m_base && loc <= end();
+  }
+
+  // 1-based line and column of `loc`, which must be inside this buffer
+  std::uint32_t line(SourceLoc loc) const;
+  std::uint32_t column(SourceLoc loc) const;
+
+  // text of a 1-based line without its newline
+  std::string_view lineText(std::uint32_t line) const;
+
+private:
+  const std::vector<std::uint32_t> &lineStarts() const;
+};
+
+// A location resolved to something a human can read.
+struct ResolvedLoc {
+  std::string_view bufferName;
+  std::uint32_t line;
+  std::uint32_t column;
+  std::string_view lineText;
+};
+
+// Owns every source buffer of a compile and maps 32-bit SourceLocs back to
+// buffers, lines and columns. Tokens and errors only carry offsets; the line
+// table of a buffer is only built when a diagnostic needs it.
+class SourceManager {
+private:
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<SourceBuffer>> m_buffers;
+  // offset 0 stays invalid
+  std::uint32_t m_next = 1;
+
+public:
+  static SourceManager &get();
+
+  // maps a file from disk, returns nullptr if it cannot be read or there are
+  // no locations left for it
+  const SourceBuffer *loadFile(const std::string &path);
+
+  // copies `text` into a new buffer, returns nullptr when there are no
+  // locations left for it
+  const SourceBuffer *addBuffer(std::string name, std::string text);
+
+  const SourceBuffer *findBuffer(SourceLoc loc) const;
+
+  std::optional<ResolvedLoc> resolve(SourceLoc loc) const;
+
+private:
+  const SourceBuffer &insert(std::unique_ptr<SourceBuffer> buffer);
+  // the base of `size` new locations, nullopt after logging why once the
+  // 32-bit location space is used up
+  std::optional<SourceLoc> reserve(std::size_t size);
+};
+
+#endif // !SOURCE_MANAGER_HPP
@@ -0,0 +1,58 @@
+#ifndef SYMBOL_TABLE_HPP
+#define SYMBOL_TABLE_HPP
+
+#include "Interner.hpp"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Scoped map from Symbol to T.
+//
+// Symbols are dense, so the table is a flat vector indexed by symbol id and
+// every lookup is a single array access. Bindings shadowed by an inner scope
+// are saved on an undo log and restored when that scope is popped.
+template <typename T> class SymbolTable {
+private:
+  std::vector<T> m_values;
+  std::vector<std::pair<Symbol, T>> m_shadowed;
+  std::vector<std::size_t> m_scopes;
+
+public:
+  void pushScope() { m_scopes.push_back(m_shadowed.size()); }
+
+  void popScope() {
+    std::size_t mark = m_scopes.back();
+    m_scopes.pop_back();
+
+    while (m_shadowed.size() > mark) {
+      auto [symbol, value] = m_shadowed.back();
+      m_values[symbol.id] = value;
+      m_shadowed.pop_back();
+    }
+  }
+
+  // binds `symbol` in the innermost scope, or globally when there is none
+  void insert(Symbol symbol, T value) {
+    if (symbol.id >= m_values.size())
+      m_values.resize(symbol.id + 1, T());
+
+    if (!m_scopes.empty())
+      m_shadowed.emplace_back(symbol, m_values[symbol.id]);
+
+    m_values[symbol.id] = value;
+  }
+
+  // returns T() for unbound symbols
+  T lookup(Symbol symbol) const {
+    return symbol.id < m_values.size() ? m_values[symbol.id] : T();
+  }
+
+  void clear() {
+    m_values.clear();
+    m_shadowed.clear();
+    m_scopes.clear();
+  }
+};
+
+#endif // !SYMBOL_TABLE_HPP
@@ -3,9 +3,10 @@
 
 #include "Location.hpp"
 #include "Object.hpp"
+#include <cstdint>
 #include <optional>
 
-enum class TokenType {
+enum class TokenType : std::uint8_t {
   // end of file
   Eof,
 
@@ -115,12 +116,14 @@ constexpr std::string_view TokenTypeToString(TokenType type) {
 }
 
 struct Token {
-  LineLoc m_lineLoc;
+  SourceRange m_range;
   TokenType m_type;
   std::optional<Object> m_value;
 
-  Token(TokenType type, std::optional<Object> value, LineLoc lineLoc)
-      : m_type(type), m_value(value), m_lineLoc(lineLoc) {}
+  Token(TokenType type, std::optional<Object> value, SourceRange range)
+      : m_type(type), m_value(value), m_range(range) {}
+
+  Token() : m_range(), m_type(TokenType::Eof), m_value(std::nullopt) {}
 };
 
 #endif // !TOKEN_HPP
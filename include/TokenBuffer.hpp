@@ -0,0 +1,75 @@
+#ifndef TOKEN_BUFFER_HPP
+#define TOKEN_BUFFER_HPP
+
+#include "Diagnostics.hpp"
+#include "SourceManager.hpp"
+#include "Token.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Packed, structure-of-arrays storage for a scanned token stream.
+//
+// A `Token` is ~40 bytes even for a `+`. Here every token costs one byte for
+// its type plus its 32-bit begin and end locations. Identifier and string lexemes
+// are sliced back out of the source on access, so only numbers pay for an
+// entry in the literal side table. Tokens are materialized back into a
+// `Token` on access.
+class TokenBuffer {
+private:
+  std::string_view m_source;
+  SourceLoc m_base;
+
+  std::vector<TokenType> m_types;
+  std::vector<std::uint32_t> m_starts;
+  std::vector<std::uint32_t> m_ends;
+
+  // sorted indices of the number tokens and their values
+  std::vector<std::uint32_t> m_numberTokens;
+  std::vector<double> m_numbers;
+
+public:
+  TokenBuffer(std::string_view source, SourceLoc base = SourceLoc())
+      : m_source(source), m_base(base) {}
+
+  // scans the whole source straight into packed storage
+  static TokenBuffer scan(std::string_view source,
+                          Diagnostics *diagnostics = nullptr,
+                          SourceLoc base = SourceLoc());
+  static TokenBuffer scan(const SourceBuffer &buffer,
+                          Diagnostics *diagnostics = nullptr);
+
+  void push(const Token &token);
+
+  std::size_t size() const { return m_types.size(); }
+  bool empty() const { return m_types.empty(); }
+
+  TokenType type(std::size_t index) const { return m_types[index]; }
+
+  Token token(std::size_t index) const;
+
+  // source text from the start of token `begin` to the end of token
+  // `end - 1`, the contents for a single string
+  std::string_view text(std::size_t begin, std::size_t end) const {
+    if (begin >= end)
+      return {};
+    return m_source.substr(m_starts[begin] - m_base.offset,
+                           m_ends[end - 1] - m_starts[begin]);
+  }
+
+  // Same as above for sequential readers. `cursor` is the position in the
+  // number side table, it is advanced past the token that was read.
+  Token token(std::size_t index, std::size_t &cursor) const;
+
+  std::vector<Token> unpack() const;
+
+  // bytes held by the buffer, used to report the per-token footprint
+  std::size_t bytesUsed() const;
+
+private:
+  Token materialize(std::size_t index, double number) const;
+};
+
+#endif // !TOKEN_BUFFER_HPP
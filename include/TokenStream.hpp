@@ -0,0 +1,119 @@
+#ifndef TOKEN_STREAM_HPP
+#define TOKEN_STREAM_HPP
+
+#include "Lexer.hpp"
+#include "Token.hpp"
+#include "TokenBuffer.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Pull-based token source consumed by the Parser.
+//
+// Tokens are either scanned on demand from a Lexer or replayed from an
+// already materialized vector or packed TokenBuffer. Only a small ring buffer holding the previous
+// token and the lookahead is kept, so the memory used while parsing a source
+// does not grow with its size and parsing starts as soon as the first token
+// is scanned.
+class TokenStream {
+private:
+  // the parser needs `previous`, `peek` and `peekNext`
+  static constexpr std::size_t RingSize = 4;
+
+  std::optional<Lexer> m_lexer;
+  std::vector<Token> m_tokens;
+  std::optional<TokenBuffer> m_packed;
+  // a range of a buffer owned by someone else, followed by `m_borrowedEof`
+  const TokenBuffer *m_borrowed = nullptr;
+  std::size_t m_borrowedEnd = 0;
+  Token m_borrowedEof;
+  std::size_t m_replayed = 0;
+  std::size_t m_numberCursor = 0;
+
+  std::array<Token, RingSize> m_ring;
+  // absolute index of the next token to be consumed
+  std::size_t m_current = 0;
+  // number of tokens pulled so far
+  std::size_t m_pulled = 0;
+
+public:
+  TokenStream(std::string_view source, Diagnostics *diagnostics = nullptr)
+      : m_lexer(Lexer(source, diagnostics)) {}
+  TokenStream(const SourceBuffer &buffer, Diagnostics *diagnostics = nullptr)
+      : m_lexer(Lexer(buffer, diagnostics)) {}
+  TokenStream(std::vector<Token> tokens) : m_tokens(std::move(tokens)) {}
+  TokenStream(TokenBuffer tokens) : m_packed(std::move(tokens)) {}
+
+  // Replays tokens `[begin, end)` of `tokens`, which must outlive the stream.
+  // The range is terminated by an `Eof` placed where the next token starts.
+  TokenStream(const TokenBuffer &tokens, std::size_t begin, std::size_t end)
+      : m_borrowed(&tokens), m_borrowedEnd(end), m_replayed(begin) {
+    if (end < tokens.size()) {
+      SourceLoc next = tokens.token(end).m_range.begin;
+      m_borrowedEof = Token(TokenType::Eof, std::nullopt, {next, next});
+    } else if (!tokens.empty()) {
+      m_borrowedEof = tokens.token(tokens.size() - 1);
+    }
+  }
+
+  Token &advance() {
+    lookahead(0);
+    m_current += 1;
+    return previous();
+  }
+
+  Token &previous() {
+    assert(m_current > 0);
+    return m_ring[(m_current - 1) % RingSize];
+  }
+
+  Token &peek() { return lookahead(0); }
+
+  Token &peekNext() { return lookahead(1); }
+
+private:
+  Token &lookahead(std::size_t distance) {
+    std::size_t index = m_current + distance;
+
+    while (m_pulled <= index) {
+      m_ring[m_pulled % RingSize] = pull();
+      m_pulled += 1;
+    }
+
+    return m_ring[index % RingSize];
+  }
+
+  Token pull() {
+    if (m_lexer.has_value())
+      return m_lexer->nextToken();
+
+    if (m_borrowed) {
+      if (m_replayed < m_borrowedEnd)
+        return m_borrowed->token(m_replayed++, m_numberCursor);
+      return m_borrowedEof;
+    }
+
+    if (m_packed.has_value()) {
+      std::size_t size = m_packed->size();
+      // keep repeating the trailing `Eof`
+      if (size > 0)
+        return m_packed->token(m_replayed < size ? m_replayed++ : size - 1,
+                               m_numberCursor);
+      return Token();
+    }
+
+    if (m_replayed < m_tokens.size())
+      return m_tokens[m_replayed++];
+
+    if (!m_tokens.empty())
+      return m_tokens.back();
+
+    return Token();
+  }
+};
+
+#endif // !TOKEN_STREAM_HPP
@@ -1,44 +1,61 @@
 #ifndef VISITOR_HPP
 #define VISITOR_HPP
 
-#include <memory>
-
-struct Expr;
-struct NumberExpr;
-struct NumberExpr;
-struct VariableExpr;
-struct BinaryExpr;
-struct CallExpr;
-
-struct BlockStmt;
-struct IfStmt;
-struct ReturnStmt;
-struct Stmt;
-struct FunctionStmt;
-struct ExpressionStmt;
-struct PrototypeStmt;
-
-template <typename T> class ExprVisitor {
-
+#include "AST.hpp"
+
+// Statically dispatched AST visitor.
+//
+// `Derived` provides a `visit(const T &)` overload for every node type it can
+// be handed, `dispatch()` switches on the node's type and calls it directly,
+// so there are no virtual calls and the compiler is free to inline them.
+// Overloads may return anything convertible to `R`.
+//
+//   struct NodeCounter : AstVisitor<NodeCounter, std::size_t> {
+//     std::size_t visit(const NumberExpr &expr) { return 1; }
+//     ...
+//   };
+template <typename Derived, typename R> class AstVisitor {
 public:
-  virtual ~ExprVisitor(){};
-  virtual T visit(const NumberExpr &expr) = 0;
-  virtual T visit(const VariableExpr &expr) = 0;
-  virtual T visit(const BinaryExpr &expr) = 0;
-  virtual T visit(const CallExpr &expr) = 0;
-};
-
-template <typename T, typename U> class StmtVisitor {
-
-public:
-  virtual ~StmtVisitor(){};
-  virtual T visit(const FunctionStmt &stmt) = 0;
-  virtual T visit(const PrototypeStmt &stmt) = 0;
-  virtual T visit(const BlockStmt &stmt) = 0;
-  virtual T visit(const IfStmt &stmt) = 0;
-
-  virtual U visit(const ExpressionStmt &stmt) = 0;
-  virtual U visit(const ReturnStmt &stmt) = 0;
+  R dispatch(const Expr &expr) {
+    switch (expr.type()) {
+    case AstType::NumberExpr:
+      return derived().visit(static_cast<const NumberExpr &>(expr));
+    case AstType::VariableExpr:
+      return derived().visit(static_cast<const VariableExpr &>(expr));
+    case AstType::BinaryExpr:
+      return derived().visit(static_cast<const BinaryExpr &>(expr));
+    case AstType::CallExpr:
+      return derived().visit(static_cast<const CallExpr &>(expr));
+    default:
+      __builtin_unreachable();
+    }
+  }
+
+  R dispatch(const Stmt &stmt) {
+    switch (stmt.type()) {
+    case AstType::ExpressionStmt:
+      return derived().visit(static_cast<const ExpressionStmt &>(stmt));
+    case AstType::IfStmt:
+      return derived().visit(static_cast<const IfStmt &>(stmt));
+    case AstType::FunctionStmt:
+      return derived().visit(static_cast<const FunctionStmt &>(stmt));
+    case AstType::BlockStmt:
+      return derived().visit(static_cast<const BlockStmt &>(stmt));
+    case AstType::ReturnStmt:
+      return derived().visit(static_cast<const ReturnStmt &>(stmt));
+    case AstType::PrototypeStmt:
+      return derived().visit(static_cast<const PrototypeStmt &>(stmt));
+    case AstType::LetStmt:
+      return derived().visit(static_cast<const LetStmt &>(stmt));
+    case AstType::AssignStmt:
+      return derived().visit(static_cast<const AssignStmt &>(stmt));
+    default:
+      __builtin_unreachable();
+    }
+  }
+
+private:
+  Derived &derived() { return static_cast<Derived &>(*this); }
 };
 
-#endif // !EXPR_VISITOR_HPP
+#endif // !VISITOR_HPP
@@ -0,0 +1,230 @@
+#include "AotCompiler.hpp"
+#include "Compiler.hpp"
+#include "Logger.hpp"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cctype>
+
+using namespace llvm;
+
+static bool writeFile(const std::string &path, StringRef contents) {
+  std::error_code error;
+  raw_fd_ostream out(path, error, sys::fs::OF_None);
+  if (error) {
+    LogError(("Could not write `" + path + "`: " + error.message()).c_str());
+    return false;
+  }
+
+  out << contents;
+  out.close();
+  if (out.has_error()) {
+    LogError(("Could not write `" + path + "`: " + out.error().message())
+                 .c_str());
+    // or the stream aborts on destruction
+    out.clear_error();
+    return false;
+  }
+
+  return true;
+}
+
+// Keywords of C and of C++, which includes the header too.
+static bool isKeyword(StringRef name) {
+  static const StringSet<> keywords = {
+      "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand",
+      "bitor", "bool", "break", "case", "catch", "char", "char8_t",
+      "char16_t", "char32_t", "class", "compl", "concept", "const",
+      "consteval", "constexpr", "constinit", "const_cast", "continue",
+      "co_await", "co_return", "co_yield", "decltype", "default", "delete",
+      "do", "double", "dynamic_cast", "else", "enum", "explicit", "export",
+      "extern", "false", "float", "for", "friend", "goto", "if", "inline",
+      "int", "long", "mutable", "namespace", "new", "noexcept", "not",
+      "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+      "protected", "public", "register", "reinterpret_cast", "requires",
+      "restrict", "return", "short", "signed", "sizeof", "static",
+      "static_assert", "static_cast", "struct", "switch", "template", "this",
+      "thread_local", "throw", "true", "try", "typedef", "typeid",
+      "typename", "typeof", "typeof_unqual", "union", "unsigned", "using",
+      "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+  };
+  return keywords.contains(name);
+}
+
+bool AotCompiler::checkNames(const std::vector<AstPtr<Stmt>> &statements) {
+  bool valid = true;
+
+  for (const auto &statement : statements) {
+    if (statement->type() != AstType::FunctionStmt)
+      continue;
+
+    auto proto = statement->as<const FunctionStmt *>()->proto.get();
+    StringRef name = Interner::get().name(proto->symbol);
+
+    // `_Bool`, `__x` and, at file scope, any leading underscore belong to
+    // the implementation
+    const char *problem = nullptr;
+    if (isKeyword(name))
+      problem = "is a C keyword";
+    else if (name.startswith("_"))
+      problem = "is reserved in C";
+
+    if (problem) {
+      LogError(("The function `" + name + "` " + problem +
+                ", it cannot be declared in the header.")
+                   .str()
+                   .c_str());
+      valid = false;
+    }
+  }
+
+  return valid;
+}
+
+bool AotCompiler::compile(const std::vector<AstPtr<Stmt>> &statements,
+                          const std::string &path, Output output,
+                          OptLevel level) {
+  auto machine = createHostMachine(level, output == Output::SharedLibrary);
+  if (!machine)
+    return false;
+
+  // one module, so definitions can be inlined into each other
+  Compiler compiler;
+  compiler.setOptLevel(level, machine.get());
+
+  // definitions may call ones further down the file, like in the JIT
+  for (const auto &statement : statements) {
+    if (statement->type() != AstType::FunctionStmt)
+      continue;
+
+    auto proto = statement->as<const FunctionStmt *>()->proto.get();
+    compiler.predeclare(proto->symbol, proto->argSymbols.size());
+  }
+
+  for (const auto &statement : statements) {
+    if (statement->type() != AstType::FunctionStmt)
+      continue;
+
+    if (!compiler.codegen(statement.get())) {
+      LogError("Compilation Error.");
+      return false;
+    }
+  }
+
+  compiler.optimize();
+
+  auto object = compiler.emitObject();
+  if (!object)
+    return false;
+
+  if (output == Output::Object)
+    return writeFile(path, object->getBuffer());
+
+  SmallString<128> objectPath;
+  if (sys::fs::createTemporaryFile("polylang", "o", objectPath)) {
+    LogError("Could not create a temporary object file.");
+    return false;
+  }
+
+  auto linker = sys::findProgramByName("cc");
+  if (!linker) {
+    LogError("No `cc` found to link a shared library with.");
+    sys::fs::remove(objectPath);
+    return false;
+  }
+
+  bool linked = false;
+  if (writeFile(objectPath.str().str(), object->getBuffer())) {
+    StringRef args[] = {*linker, "-shared", "-o", path, objectPath};
+    std::string message;
+    linked = sys::ExecuteAndWait(*linker, makeArrayRef(args), None, {}, 0, 0,
+                                 &message) == 0;
+    if (!linked)
+      LogError(("Linking `" + path + "` failed. " + message).c_str());
+  }
+
+  sys::fs::remove(objectPath);
+  return linked;
+}
+
+std::unique_ptr<TargetMachine> AotCompiler::createHostMachine(OptLevel level,
+                                                              bool pic) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  std::string triple = sys::getProcessTriple();
+  std::string error;
+  const Target *target = TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    LogError(error.c_str());
+    return nullptr;
+  }
+
+  SubtargetFeatures features;
+  StringMap<bool> hostFeatures;
+  if (sys::getHostCPUFeatures(hostFeatures))
+    for (const auto &feature : hostFeatures)
+      features.AddFeature(feature.first(), feature.second);
+
+  return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+      triple, sys::getHostCPUName(), features.getString(), TargetOptions(),
+      pic ? Reloc::PIC_ : Reloc::Static, None,
+      codeGenOptLevel(level)));
+}
+
+std::string AotCompiler::header(const std::vector<AstPtr<Stmt>> &statements,
+                                std::string_view guard) {
+  std::string text = "// Generated by PolyLang, do not edit.\n";
+  text += "#ifndef " + std::string(guard) + "\n";
+  text += "#define " + std::string(guard) + "\n\n";
+  text += "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+
+  for (const auto &statement : statements) {
+    if (statement->type() != AstType::FunctionStmt)
+      continue;
+
+    auto proto = statement->as<const FunctionStmt *>()->proto.get();
+    text += "double " + std::string(Interner::get().name(proto->symbol)) + "(";
+
+    // only types, argument names may well be C keywords
+    for (std::size_t i = 0; i < proto->argSymbols.size(); i++)
+      text += i > 0 ? ", double" : "double";
+
+    text += proto->argSymbols.empty() ? "void);\n" : ");\n";
+  }
+
+  text += "\n#ifdef __cplusplus\n}\n#endif\n\n";
+  text += "#endif // " + std::string(guard) + "\n";
+  return text;
+}
+
+std::string AotCompiler::headerPathFor(const std::string &path) {
+  SmallString<128> header(path);
+  sys::path::replace_extension(header, "h");
+  return header.str().str();
+}
+
+bool AotCompiler::writeHeader(const std::vector<AstPtr<Stmt>> &statements,
+                              const std::string &path) {
+  std::string headerPath = headerPathFor(path);
+
+  // KERNELS_H for kernels.h
+  std::string guard = sys::path::filename(headerPath).str();
+  for (char &c : guard)
+    c = std::isalnum(static_cast<unsigned char>(c))
+            ? std::toupper(static_cast<unsigned char>(c))
+            : '_';
+  if (guard.empty() || std::isdigit(static_cast<unsigned char>(guard[0])))
+    guard = "POLYLANG_" + guard;
+
+  return writeFile(headerPath, header(statements, guard));
+}
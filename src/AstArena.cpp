@@ -0,0 +1,30 @@
+#include "AstArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+void *AstArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  auto align = [alignment](std::byte *pointer) {
+    auto address = reinterpret_cast<std::uintptr_t>(pointer);
+    auto aligned = (address + alignment - 1) & ~(alignment - 1);
+    return pointer + (aligned - address);
+  };
+
+  std::byte *start = m_cursor ? align(m_cursor) : nullptr;
+
+  if (!start || start + bytes > m_end) {
+    // oversized requests get a slab of their own
+    std::size_t size = std::max(SLAB_SIZE, bytes + alignment);
+    // not value initialized, every byte is written before it is read
+    m_slabs.emplace_back(new std::byte[size]);
+    m_bytesReserved += size;
+
+    m_cursor = m_slabs.back().get();
+    m_end = m_cursor + size;
+    start = align(m_cursor);
+  }
+
+  m_bytesUsed += (start + bytes) - m_cursor;
+  m_cursor = start + bytes;
+  return start;
+}
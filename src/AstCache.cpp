@@ -0,0 +1,356 @@
+#include "AstCache.hpp"
+#include "AST.hpp"
+#include "SourceFile.hpp"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/xxhash.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr char MAGIC[4] = {'P', 'L', 'A', 'C'};
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t sourceHash;
+  std::uint32_t nodes;
+  std::uint32_t numbers;
+  std::uint32_t lists;
+  std::uint32_t roots;
+  std::uint32_t symbols;
+  std::uint32_t nameBytes;
+};
+
+// The header is followed by, in order: numbers, operands, subtree starts,
+// lists, roots, name offsets (one more than there are symbols), node types and
+// the names.
+static_assert(sizeof(Header) == 40, "numbers must stay 8 byte aligned");
+
+template <typename T>
+void appendArray(std::string &out, const std::vector<T> &array) {
+  out.append(reinterpret_cast<const char *>(array.data()),
+             array.size() * sizeof(T));
+}
+
+bool isExpression(AstType type) {
+  switch (type) {
+  case AstType::NumberExpr:
+  case AstType::VariableExpr:
+  case AstType::BinaryExpr:
+  case AstType::CallExpr:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool hasSymbol(AstType type) {
+  return type == AstType::VariableExpr || type == AstType::CallExpr ||
+         type == AstType::PrototypeStmt || type == AstType::LetStmt ||
+         type == AstType::AssignStmt;
+}
+} // namespace
+
+std::string AstCache::pathFor(const std::string &sourcePath) {
+  return sourcePath + ".astc";
+}
+
+std::uint64_t AstCache::hashSource(std::string_view source) {
+  return llvm::xxHash64(llvm::StringRef(source.data(), source.size()));
+}
+
+std::string AstCache::serialize(const FlatAst &ast, std::uint64_t sourceHash) {
+  // symbol ids are replaced by indices into the name table of the file
+  llvm::DenseMap<std::uint32_t, std::uint32_t> local;
+  std::vector<std::string_view> names;
+
+  auto localize = [&](std::uint32_t id) {
+    auto [entry, inserted] = local.try_emplace(id, names.size());
+    if (inserted)
+      names.push_back(Interner::get().name(Symbol{id}));
+    return entry->second;
+  };
+
+  std::vector<FlatAst::Operands> operands = ast.m_operands;
+  std::vector<std::uint32_t> lists = ast.m_lists;
+
+  for (NodeId node = 0; node < ast.size(); node++) {
+    AstType type = ast.type(node);
+    if (!hasSymbol(type))
+      continue;
+
+    operands[node][0] = localize(operands[node][0]);
+
+    if (type == AstType::PrototypeStmt)
+      for (std::uint32_t i = 0; i < operands[node][2]; i++)
+        lists[operands[node][1] + i] = localize(lists[operands[node][1] + i]);
+  }
+
+  std::vector<std::uint32_t> nameOffsets = {0};
+  for (std::string_view name : names)
+    nameOffsets.push_back(nameOffsets.back() + name.size());
+
+  Header header = {
+      {MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3]},
+      VERSION,
+      sourceHash,
+      static_cast<std::uint32_t>(ast.size()),
+      static_cast<std::uint32_t>(ast.m_numbers.size()),
+      static_cast<std::uint32_t>(lists.size()),
+      static_cast<std::uint32_t>(ast.m_roots.size()),
+      static_cast<std::uint32_t>(names.size()),
+      nameOffsets.back(),
+  };
+
+  std::string out;
+  out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  appendArray(out, ast.m_numbers);
+  appendArray(out, operands);
+  appendArray(out, ast.m_subtreeStarts);
+  appendArray(out, lists);
+  appendArray(out, ast.m_roots);
+  appendArray(out, nameOffsets);
+  appendArray(out, ast.m_types);
+  for (std::string_view name : names)
+    out.append(name);
+
+  return out;
+}
+
+std::optional<FlatAst> AstCache::deserialize(std::string_view data,
+                                             std::uint64_t sourceHash) {
+  Header header;
+  if (data.size() < sizeof(header))
+    return std::nullopt;
+
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.sourceHash != sourceHash)
+    return std::nullopt;
+
+  std::size_t offset = sizeof(header);
+
+  auto read = [&](auto &array, std::size_t count) {
+    std::size_t bytes = count * sizeof(array[0]);
+    if (data.size() - offset < bytes)
+      return false;
+
+    array.resize(count);
+    std::memcpy(array.data(), data.data() + offset, bytes);
+    offset += bytes;
+    return true;
+  };
+
+  FlatAst ast;
+  std::vector<std::uint32_t> nameOffsets;
+
+  if (!read(ast.m_numbers, header.numbers) ||
+      !read(ast.m_operands, header.nodes) ||
+      !read(ast.m_subtreeStarts, header.nodes) ||
+      !read(ast.m_lists, header.lists) || !read(ast.m_roots, header.roots) ||
+      !read(nameOffsets, std::size_t(header.symbols) + 1) ||
+      !read(ast.m_types, header.nodes))
+    return std::nullopt;
+
+  if (data.size() - offset != header.nameBytes || !isWellFormed(ast))
+    return std::nullopt;
+
+  std::string_view nameData = data.substr(offset);
+  std::vector<Symbol> symbols;
+  symbols.reserve(header.symbols);
+
+  for (std::uint32_t i = 0; i < header.symbols; i++) {
+    std::uint32_t begin = nameOffsets[i];
+    std::uint32_t end = nameOffsets[i + 1];
+    if (begin > end || end > nameData.size())
+      return std::nullopt;
+
+    symbols.push_back(Interner::get().intern(nameData.substr(begin, end - begin)));
+  }
+
+  auto globalize = [&](std::uint32_t &id) {
+    if (id >= symbols.size())
+      return false;
+    id = symbols[id].id;
+    return true;
+  };
+
+  for (NodeId node = 0; node < ast.size(); node++) {
+    AstType type = ast.type(node);
+    if (!hasSymbol(type))
+      continue;
+
+    FlatAst::Operands &operands = ast.m_operands[node];
+    if (!globalize(operands[0]))
+      return std::nullopt;
+
+    if (type == AstType::PrototypeStmt)
+      for (std::uint32_t i = 0; i < operands[2]; i++)
+        if (!globalize(ast.m_lists[operands[1] + i]))
+          return std::nullopt;
+  }
+
+  return ast;
+}
+
+bool AstCache::write(const std::string &path, const FlatAst &ast,
+                     std::uint64_t sourceHash) {
+  std::string data = serialize(ast, sourceHash);
+  std::string temporary = path + ".tmp." + std::to_string(::getpid());
+
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    // buffered bytes only reach the disk, or fail to, on close
+    out.close();
+    if (out.fail()) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+std::optional<FlatAst> AstCache::load(const std::string &path,
+                                      std::uint64_t sourceHash) {
+  std::optional<SourceFile> file = SourceFile::open(path);
+  if (!file.has_value())
+    return std::nullopt;
+
+  return deserialize(file->contents(), sourceHash);
+}
+
+bool AstCache::isWellFormed(const FlatAst &ast) {
+  std::size_t size = ast.size();
+  // nodes that are some other node's child, these cannot be roots
+  std::vector<bool> isReferenced(size, false);
+
+  // a child and its whole subtree have to be inside the subtree of its parent
+  auto isChild = [&](NodeId node, std::uint32_t child) {
+    if (child >= node || ast.subtreeStart(child) < ast.subtreeStart(node))
+      return false;
+    isReferenced[child] = true;
+    return true;
+  };
+  auto isExpr = [&](NodeId node, std::uint32_t child) {
+    return isChild(node, child) && isExpression(ast.type(child));
+  };
+  auto isA = [&](NodeId node, std::uint32_t child, AstType type) {
+    return isChild(node, child) && ast.type(child) == type;
+  };
+  auto isList = [&](std::uint64_t begin, std::uint64_t length) {
+    return begin + length <= ast.m_lists.size();
+  };
+
+  for (NodeId node = 0; node < size; node++) {
+    const FlatAst::Operands &operands = ast.operands(node);
+
+    if (ast.subtreeStart(node) > node)
+      return false;
+
+    switch (ast.type(node)) {
+    case AstType::NumberExpr:
+      if (operands[0] >= ast.m_numbers.size())
+        return false;
+      break;
+
+    case AstType::VariableExpr:
+      break;
+
+    case AstType::BinaryExpr:
+      if (!isExpr(node, operands[0]) || !isExpr(node, operands[1]) ||
+          operands[2] > static_cast<std::uint32_t>(TokenType::String))
+        return false;
+      break;
+
+    case AstType::CallExpr:
+      if (!isList(operands[1], operands[2]))
+        return false;
+      for (std::uint32_t arg : ast.list(node))
+        if (!isExpr(node, arg))
+          return false;
+      break;
+
+    case AstType::PrototypeStmt:
+      if (!isList(operands[1], operands[2]))
+        return false;
+      break;
+
+    case AstType::FunctionStmt:
+      if (!isA(node, operands[0], AstType::PrototypeStmt) ||
+          !isA(node, operands[1], AstType::BlockStmt))
+        return false;
+      break;
+
+    case AstType::BlockStmt:
+      if (!isList(operands[0], operands[1]) ||
+          (operands[2] != NO_NODE &&
+           !isA(node, operands[2], AstType::ReturnStmt)))
+        return false;
+      for (std::uint32_t statement : ast.list(node))
+        if (!isChild(node, statement) || isExpression(ast.type(statement)))
+          return false;
+      break;
+
+    case AstType::ReturnStmt:
+      if (operands[0] != NO_NODE && !isExpr(node, operands[0]))
+        return false;
+      break;
+
+    case AstType::ExpressionStmt:
+      if (!isExpr(node, operands[0]))
+        return false;
+      break;
+
+    case AstType::LetStmt:
+    case AstType::AssignStmt:
+      if (!isExpr(node, operands[1]))
+        return false;
+      break;
+
+    case AstType::IfStmt:
+      if (!isExpr(node, operands[0]) ||
+          !isA(node, operands[1], AstType::BlockStmt) ||
+          (operands[2] != NO_NODE && !isA(node, operands[2], AstType::IfStmt)) ||
+          (operands[3] != NO_NODE &&
+           !isA(node, operands[3], AstType::BlockStmt)))
+        return false;
+      break;
+
+    default:
+      return false;
+    }
+  }
+
+  // only what the parser produces at the top level, the compiler lowers
+  // anything else assuming it is inside a function
+  for (NodeId root : ast.roots()) {
+    if (root >= size || isReferenced[root])
+      return false;
+
+    switch (ast.type(root)) {
+    case AstType::FunctionStmt:
+    case AstType::ExpressionStmt:
+    case AstType::IfStmt:
+    case AstType::PrototypeStmt:
+      break;
+    default:
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,204 @@
+#include "CharScan.hpp"
+
+#include <cstring>
+
+// SSE2 is part of the x86-64 baseline, AVX2 is detected at runtime
+#if defined(__x86_64__)
+#define POLYLANG_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Kernels {
+  const char *(*skipWhitespace)(const char *, const char *);
+  const char *(*skipIdentifier)(const char *, const char *);
+  const char *(*skipDigits)(const char *, const char *);
+  const char *name;
+};
+
+// scalar kernels, also used for the tails of the vectorized ones
+
+const char *skipWhitespaceScalar(const char *begin, const char *end) {
+  while (begin < end && isWhitespace(*begin))
+    begin++;
+  return begin;
+}
+
+const char *skipIdentifierScalar(const char *begin, const char *end) {
+  while (begin < end && isIdentifierChar(*begin))
+    begin++;
+  return begin;
+}
+
+const char *skipDigitsScalar(const char *begin, const char *end) {
+  while (begin < end && isDigit(*begin))
+    begin++;
+  return begin;
+}
+
+#ifdef POLYLANG_X86
+
+// Bytes >= 0x80 compare as negative with the signed comparisons below, so
+// they never fall inside any of the ranges.
+
+__m128i inRange16(__m128i chars, char low, char high) {
+  return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)),
+                       _mm_cmplt_epi8(chars, _mm_set1_epi8(high + 1)));
+}
+
+const char *skipWhitespaceSSE2(const char *begin, const char *end) {
+  while (end - begin >= 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    __m128i space = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')),
+                     _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n'))));
+
+    unsigned stop = ~_mm_movemask_epi8(space) & 0xFFFF;
+    if (stop)
+      return begin + __builtin_ctz(stop);
+
+    begin += 16;
+  }
+  return skipWhitespaceScalar(begin, end);
+}
+
+const char *skipIdentifierSSE2(const char *begin, const char *end) {
+  while (end - begin >= 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    // folding to lower case maps both letter ranges onto 'a'..'z'
+    __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i ident = _mm_or_si128(
+        _mm_or_si128(inRange16(lower, 'a', 'z'), inRange16(chars, '0', '9')),
+        _mm_cmpeq_epi8(chars, _mm_set1_epi8('_')));
+
+    unsigned stop = ~_mm_movemask_epi8(ident) & 0xFFFF;
+    if (stop)
+      return begin + __builtin_ctz(stop);
+
+    begin += 16;
+  }
+  return skipIdentifierScalar(begin, end);
+}
+
+const char *skipDigitsSSE2(const char *begin, const char *end) {
+  while (end - begin >= 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+
+    unsigned stop =
+        ~_mm_movemask_epi8(inRange16(chars, '0', '9')) & 0xFFFF;
+    if (stop)
+      return begin + __builtin_ctz(stop);
+
+    begin += 16;
+  }
+  return skipDigitsScalar(begin, end);
+}
+
+__attribute__((target("avx2"))) __m256i inRange32(__m256i chars, char low,
+                                                  char high) {
+  return _mm256_and_si256(
+      _mm256_cmpgt_epi8(chars, _mm256_set1_epi8(low - 1)),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chars));
+}
+
+__attribute__((target("avx2"))) const char *
+skipWhitespaceAVX2(const char *begin, const char *end) {
+  while (end - begin >= 32) {
+    __m256i chars =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+    __m256i space = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\r')),
+                        _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n'))));
+
+    unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(space));
+    if (stop)
+      return begin + __builtin_ctz(stop);
+
+    begin += 32;
+  }
+  return skipWhitespaceSSE2(begin, end);
+}
+
+__attribute__((target("avx2"))) const char *
+skipIdentifierAVX2(const char *begin, const char *end) {
+  while (end - begin >= 32) {
+    __m256i chars =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+    __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    __m256i ident = _mm256_or_si256(
+        _mm256_or_si256(inRange32(lower, 'a', 'z'),
+                        inRange32(chars, '0', '9')),
+        _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_')));
+
+    unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(ident));
+    if (stop)
+      return begin + __builtin_ctz(stop);
+
+    begin += 32;
+  }
+  return skipIdentifierSSE2(begin, end);
+}
+
+__attribute__((target("avx2"))) const char *
+skipDigitsAVX2(const char *begin, const char *end) {
+  while (end - begin >= 32) {
+    __m256i chars =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+
+    unsigned stop = ~static_cast<unsigned>(
+        _mm256_movemask_epi8(inRange32(chars, '0', '9')));
+    if (stop)
+      return begin + __builtin_ctz(stop);
+
+    begin += 32;
+  }
+  return skipDigitsSSE2(begin, end);
+}
+
+#endif // POLYLANG_X86
+
+Kernels selectKernels() {
+#ifdef POLYLANG_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return {skipWhitespaceAVX2, skipIdentifierAVX2, skipDigitsAVX2, "avx2"};
+
+  return {skipWhitespaceSSE2, skipIdentifierSSE2, skipDigitsSSE2, "sse2"};
+#else
+  return {skipWhitespaceScalar, skipIdentifierScalar, skipDigitsScalar,
+          "scalar"};
+#endif
+}
+
+const Kernels &kernels() {
+  static const Kernels selected = selectKernels();
+  return selected;
+}
+
+} // namespace
+
+const char *skipWhitespace(const char *begin, const char *end) {
+  return kernels().skipWhitespace(begin, end);
+}
+
+const char *skipIdentifier(const char *begin, const char *end) {
+  return kernels().skipIdentifier(begin, end);
+}
+
+const char *skipDigits(const char *begin, const char *end) {
+  return kernels().skipDigits(begin, end);
+}
+
+const char *findNewline(const char *begin, const char *end) {
+  // glibc's memchr already scans 16 to 64 bytes at a time
+  const void *newline = std::memchr(begin, '\n', end - begin);
+  return newline ? static_cast<const char *>(newline) : end;
+}
+
+const char *charScanImplementation() { return kernels().name; }
@@ -1,185 +1,542 @@
 #include "Compiler.hpp"
 #include "AST.hpp"
 #include "Logger.hpp"
+#include "ThreadPool.hpp"
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <future>
 #include <vector>
 
 using namespace llvm;
 
 Value *Compiler::codegen(const Expr *const expr) {
-  return expr->accept(*this);
-};
+  // post-order walk with an explicit stack, deeply nested expressions must not
+  // overflow the call stack
+  m_exprWork.clear();
+  m_exprValues.clear();
+  m_exprWork.push_back({expr, false});
+
+  while (!m_exprWork.empty()) {
+    auto [node, expanded] = m_exprWork.back();
+    m_exprWork.pop_back();
+
+    Value *value = nullptr;
+
+    switch (node->type()) {
+    case AstType::NumberExpr:
+      value = visit(static_cast<const NumberExpr &>(*node));
+      break;
+
+    case AstType::VariableExpr:
+      value = visit(static_cast<const VariableExpr &>(*node));
+      break;
+
+    case AstType::BinaryExpr: {
+      auto binary = static_cast<const BinaryExpr *>(node);
+
+      if (!expanded) {
+        if (Value *shared = m_sharedValues.lookup(node)) {
+          m_exprValues.push_back(shared);
+          continue;
+        }
+
+        m_exprWork.push_back({node, true});
+        m_exprWork.push_back({binary->right(), false});
+        m_exprWork.push_back({binary->left(), false});
+        continue;
+      }
+
+      Value *R = m_exprValues.back();
+      m_exprValues.pop_back();
+      Value *L = m_exprValues.back();
+      m_exprValues.pop_back();
+      value = emitBinary(binary->operation, L, R);
+      m_sharedValues[node] = value;
+      break;
+    }
+
+    case AstType::CallExpr: {
+      auto call = static_cast<const CallExpr *>(node);
+
+      if (!expanded) {
+        if (Value *shared = m_sharedValues.lookup(node)) {
+          m_exprValues.push_back(shared);
+          continue;
+        }
+
+        m_exprWork.push_back({node, true});
+        for (auto arg = call->args.rbegin(); arg != call->args.rend(); ++arg)
+          m_exprWork.push_back({arg->get(), false});
+        continue;
+      }
+
+      std::size_t first = m_exprValues.size() - call->args.size();
+      value = emitCall(call->calleeSymbol,
+                       ArrayRef<Value *>(m_exprValues).drop_front(first));
+      m_exprValues.resize(first);
+      m_sharedValues[node] = value;
+      break;
+    }
+
+    default:
+      break;
+    }
+
+    if (!value)
+      return nullptr;
 
-Value *Compiler::codegen(const Stmt *const stmt) {
-  return stmt->accept(*this);
+    m_exprValues.push_back(value);
+  }
+
+  return m_exprValues.back();
 };
 
+Value *Compiler::codegen(const Stmt *const stmt) { return dispatch(*stmt); };
+
 Value *Compiler::visit(const NumberExpr &expr) {
   return ConstantFP::get(*m_context, llvm::APFloat(expr.value));
 }
 
 Value *Compiler::visit(const VariableExpr &expr) {
+  return emitVariable(expr.symbol);
+}
 
-  Value *v = m_namedValues[expr.name];
+Value *Compiler::visit(const BinaryExpr &expr) { return codegen(&expr); }
 
-  if (!v)
-    LogError("Unknown variable name.");
+Value *Compiler::visit(const CallExpr &expr) { return codegen(&expr); }
 
-  return v;
+Function *Compiler::visit(const PrototypeStmt &stmt) {
+  return emitPrototype(stmt.symbol, stmt.argSymbols);
 }
 
-Value *Compiler::visit(const BinaryExpr &expr) {
-  Value *L = codegen(expr.left());
-  Value *R = codegen(expr.right());
+// the enclosing function, null when a statement failed to compile
+Function *Compiler::visit(const BlockStmt &stmt) {
 
-  if (!L || !R)
+  for (const auto &stmt : stmt.statements) {
+    if (!codegen(stmt.get()))
+      return nullptr;
+  }
+
+  if (!codegen(stmt.returnStmt.get()))
     return nullptr;
+  return m_builder->GetInsertBlock()->getParent();
+}
 
-  switch (expr.operation) {
-  case TokenType::Plus:
-    return m_builder->CreateFAdd(L, R, "addtmp");
-  case TokenType::Minus:
-    return m_builder->CreateFSub(L, R, "subtmp");
-  case TokenType::Star:
-    return m_builder->CreateFMul(L, R, "multmp");
-  case TokenType::Slash:
-    return m_builder->CreateFDiv(L, R, "divtmp");
+Value *Compiler::visit(const ReturnStmt &stmt) {
 
-  case TokenType::BangEqual:
-    L = m_builder->CreateFCmpUNE(L, R, "cmptmp");
-    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
-                                   "booltmp");
-  case TokenType::Lesser:
-    L = m_builder->CreateFCmpULT(L, R, "cmptmp");
-    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
-                                   "booltmp");
-  case TokenType::LesserEqual:
-    L = m_builder->CreateFCmpULE(L, R, "cmptmp");
-    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
-                                   "booltmp");
-  case TokenType::Greater:
-    L = m_builder->CreateFCmpUGT(L, R, "cmptmp");
-    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
-                                   "booltmp");
-  case TokenType::GreaterEqual:
-    L = m_builder->CreateFCmpUGE(L, R, "cmptmp");
-    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
-                                   "booltmp");
+  if (stmt.returnValue) {
+    auto retVal = codegen(stmt.returnValue.get());
+    if (!retVal)
+      return nullptr;
+    return m_builder->CreateRet(retVal);
+  }
 
-  default:
-    LogError("Invalid binary operator");
+  return m_builder->CreateRetVoid();
+}
+
+Value *Compiler::visit(const LetStmt &stmt) {
+  Value *value = codegen(stmt.value.get());
+  if (!value)
     return nullptr;
-  }
+  return emitLet(stmt.symbol, value);
 }
 
-Value *Compiler::visit(const CallExpr &expr) {
+Value *Compiler::visit(const AssignStmt &stmt) {
+  Value *value = codegen(stmt.value.get());
+  if (!value)
+    return nullptr;
+  return emitAssign(stmt.symbol, value);
+}
 
-  Function *CalleeF = m_module->getFunction(expr.callee);
+Function *Compiler::visit(const FunctionStmt &stmt) {
 
-  std::size_t args_size = expr.args.size();
+  auto proto = stmt.proto.get();
+  auto body = stmt.body.get();
 
-  if (!CalleeF) {
-    LogError("Unknown function referenced");
+  // a function compiled into an earlier module is defined again
+  Function *TheFunction = m_functions.lookup(proto->symbol);
+
+  if (!TheFunction)
+    TheFunction = static_cast<Function *>(codegen(proto));
+
+  if (!TheFunction)
     return nullptr;
-  }
 
-  if (CalleeF->arg_size() != args_size) {
-    LogError("Unknown function referenced");
+  m_namedValues.pushScope();
+  unsigned Idx = 0;
+  for (auto &Arg : TheFunction->args())
+    m_namedValues.insert(proto->argSymbols[Idx++], &Arg);
+
+  BasicBlock *BB = BasicBlock::Create(*m_context, "entry", TheFunction);
+  m_builder->SetInsertPoint(BB);
+  m_sharedValues.clear();
+
+  bool compiled = codegen(body);
+  m_namedValues.popScope();
+
+  if (!compiled) {
+    eraseFunction(proto->symbol);
     return nullptr;
   }
 
-  std::vector<llvm::Value *> argsV;
+  verifyFunction(*TheFunction);
 
-  for (unsigned i = 0; i != args_size; ++i) {
-    // compile
-    argsV.push_back(codegen(expr.args[i].get()));
+  return TheFunction;
+}
 
-    // if the last arg is a nullptr
-    if (!argsV.back())
-      return nullptr;
+Value *Compiler::visit(const ExpressionStmt &stmt) {
+
+  auto Proto = stmt.proto.get();
+  auto Body = stmt.body.get();
+
+  Function *TheFunction = m_functions.lookup(Proto->symbol);
+
+  if (!TheFunction)
+    TheFunction = static_cast<Function *>(codegen(Proto));
+
+  if (!TheFunction)
+    return nullptr;
+
+  BasicBlock *BB = BasicBlock::Create(*m_context, "entry", TheFunction);
+  m_builder->SetInsertPoint(BB);
+  m_sharedValues.clear();
+
+  // top level expressions see no variables
+  m_namedValues.pushScope();
+  Value *RetVal = codegen(Body);
+  m_namedValues.popScope();
+
+  if (RetVal) {
+    // Finish off the function.
+    m_builder->CreateRet(RetVal);
+
+    // Validate the generated code, checking for consistency.
+    verifyFunction(*TheFunction);
+
+    return TheFunction;
   }
 
-  return m_builder->CreateCall(CalleeF, argsV, "calltmp");
+  // Error reading body, remove function.
+  eraseFunction(Proto->symbol);
+  return nullptr;
 }
 
-Function *Compiler::visit(const PrototypeStmt &stmt) {
+Function *Compiler::getFunction(Symbol name) {
+  if (Function *function = m_functions.lookup(name))
+    return function;
 
-  auto Args = stmt.args;
+  if (std::optional<std::size_t> arity = m_arities.lookup(name))
+    return declare(name, *arity);
 
-  std::vector<llvm::Type *> Doubles(Args.size(), Type::getDoubleTy(*m_context));
-  FunctionType *FT =
-      FunctionType::get(Type::getDoubleTy(*m_context), Doubles, false);
-  Function *F = Function::Create(FT, Function::ExternalLinkage, stmt.name,
-                                 m_module.get());
+  return nullptr;
+}
 
-  unsigned Idx = 0;
-  for (auto &Arg : F->args())
-    Arg.setName(Args[Idx++]);
+llvm::orc::ThreadSafeModule Compiler::takeModule() {
+  llvm::orc::ThreadSafeModule module(std::move(m_module), std::move(m_context));
+  m_functions.clear();
+  initializeModuleAndPassManager();
+  return module;
+}
 
-  return F;
+void Compiler::setOptLevel(OptLevel level, llvm::TargetMachine *machine) {
+  m_machine = machine;
+  if (m_machine) {
+    m_module->setDataLayout(m_machine->createDataLayout());
+    m_module->setTargetTriple(m_machine->getTargetTriple().str());
+  }
+
+  if (level == OptLevel::O0)
+    m_optimizer = nullptr;
+  else
+    m_optimizer = std::make_unique<Optimizer>(level, machine);
 }
 
-Function *Compiler::visit(const BlockStmt &stmt) {
+std::unique_ptr<MemoryBuffer> Compiler::emitObject() {
+  if (!m_machine) {
+    LogError("No target machine to emit an object for.");
+    return nullptr;
+  }
 
-  for (const auto &stmt : stmt.statements) {
-    codegen(stmt.get());
+  SmallVector<char, 0> object;
+  raw_svector_ostream stream(object);
+
+  legacy::PassManager passes;
+  if (m_machine->addPassesToEmitFile(passes, stream, nullptr,
+                                     CGFT_ObjectFile)) {
+    LogError("The target machine cannot emit objects.");
+    return nullptr;
   }
 
-  codegen(stmt.returnStmt.get());
-  return nullptr;
+  passes.run(*m_module);
+  return std::make_unique<SmallVectorMemoryBuffer>(std::move(object));
 }
 
-Value *Compiler::visit(const ReturnStmt &stmt) {
+CompiledShards Compiler::compileParallel(
+    const std::vector<AstPtr<Stmt>> &statements, ThreadPool &pool,
+    const std::function<std::unique_ptr<TargetMachine>()> &createMachine,
+    const ShardOptions &options) {
+  std::vector<const FunctionStmt *> functions;
+  // every shard may call any definition
+  SymbolTable<std::optional<std::size_t>> arities;
+
+  for (const auto &statement : statements) {
+    if (statement->type() != AstType::FunctionStmt)
+      continue;
+
+    auto function = statement->as<const FunctionStmt *>();
+    functions.push_back(function);
+    arities.insert(function->proto->symbol,
+                   function->proto->argSymbols.size());
+  }
 
-  if (stmt.returnValue) {
-    auto retVal = codegen(stmt.returnValue.get());
-    m_builder->CreateRet(retVal);
-  } else {
-    m_builder->CreateRetVoid();
+  if (functions.empty())
+    return {};
+
+  std::size_t shards = options.shards ? options.shards : pool.size() * 4;
+  std::size_t shardSize = (functions.size() + shards - 1) / shards;
+
+  struct Shard {
+    std::unique_ptr<MemoryBuffer> object;
+    std::string ir;
+    std::size_t failures = 0;
+    bool cached = false;
+  };
+
+  std::vector<std::future<Shard>> pending;
+  for (std::size_t begin = 0; begin < functions.size(); begin += shardSize) {
+    std::size_t end = std::min(begin + shardSize, functions.size());
+
+    pending.push_back(pool.submit([&, begin, end]() {
+      Shard shard;
+
+      // target machines are not shared between threads
+      std::unique_ptr<TargetMachine> machine = createMachine();
+      if (!machine) {
+        shard.failures = end - begin;
+        return shard;
+      }
+
+      Compiler compiler;
+      compiler.setOptLevel(options.level, machine.get());
+      compiler.m_arities = arities;
+
+      for (std::size_t i = begin; i < end; i++) {
+        if (!compiler.codegen(functions[i])) {
+          shard.failures += 1;
+          compiler.eraseFunction(functions[i]->proto->symbol);
+        }
+      }
+
+      // keyed before optimizing, a hit skips the optimizer too
+      std::uint64_t key = 0;
+      if (options.cache) {
+        std::string salt = ::ObjectCache::describe(*machine, options.level);
+        key = ::ObjectCache::key(*compiler.m_module, salt + " then optimized");
+        if (options.readCache)
+          shard.object = options.cache->lookup(key);
+        shard.cached = shard.object != nullptr;
+      }
+
+      if (!shard.object)
+        compiler.optimize();
+
+      if (options.keepIR) {
+        raw_string_ostream stream(shard.ir);
+        compiler.m_module->print(stream, nullptr);
+      }
+
+      if (shard.object)
+        return shard;
+
+      shard.object = compiler.emitObject();
+      if (!shard.object)
+        shard.failures = end - begin;
+      else if (options.cache)
+        options.cache->store(key, *shard.object);
+      return shard;
+    }));
+  }
+
+  CompiledShards compiled;
+  for (auto &future : pending) {
+    Shard shard = future.get();
+
+    compiled.failures += shard.failures;
+    compiled.cached += shard.cached;
+    if (shard.object)
+      compiled.objects.push_back(std::move(shard.object));
+    if (options.keepIR)
+      compiled.ir.push_back(std::move(shard.ir));
+  }
+
+  return compiled;
+}
+
+void Compiler::eraseFunction(Symbol name) {
+  if (Function *function = m_functions.lookup(name)) {
+    function->eraseFromParent();
+    m_functions.insert(name, nullptr);
   }
+}
 
+Function *Compiler::visit(const IfStmt &stmt) {
+  LogError("If statements cannot be compiled yet.");
   return nullptr;
 }
 
-Function *Compiler::visit(const FunctionStmt &stmt) {
+Value *Compiler::codegen(const FlatAst &ast, NodeId node) {
+  const FlatAst::Operands &operands = ast.operands(node);
 
-  auto proto = stmt.proto.get();
-  auto body = stmt.body.get();
+  switch (ast.type(node)) {
+  case AstType::FunctionStmt:
+    return codegenFlatFunction(ast, node);
+
+  case AstType::ExpressionStmt:
+    return codegenFlatExpressionStmt(ast, node);
+
+  case AstType::PrototypeStmt: {
+    llvm::SmallVector<Symbol, 8> args;
+    for (std::uint32_t arg : ast.list(node))
+      args.push_back(Symbol{arg});
+    return emitPrototype(ast.symbol(node), args);
+  }
+
+  case AstType::BlockStmt:
+    for (NodeId statement : ast.list(node))
+      if (!codegen(ast, statement))
+        return nullptr;
 
-  Function *TheFunction = m_module->getFunction(proto->name);
+    if (operands[2] != NO_NODE && !codegen(ast, operands[2]))
+      return nullptr;
+    return m_builder->GetInsertBlock()->getParent();
+
+  case AstType::ReturnStmt: {
+    if (operands[0] == NO_NODE)
+      return m_builder->CreateRetVoid();
+
+    Value *value = codegenFlat(ast, operands[0]);
+    return value ? m_builder->CreateRet(value) : nullptr;
+  }
+
+  case AstType::LetStmt:
+  case AstType::AssignStmt: {
+    Value *value = codegenFlat(ast, operands[1]);
+    if (!value)
+      return nullptr;
+
+    if (ast.type(node) == AstType::LetStmt)
+      return emitLet(ast.symbol(node), value);
+    return emitAssign(ast.symbol(node), value);
+  }
+
+  case AstType::IfStmt:
+    LogError("If statements cannot be compiled yet.");
+    return nullptr;
+
+  default:
+    return codegenFlat(ast, node);
+  }
+}
+
+Value *Compiler::codegenFlat(const FlatAst &ast, NodeId root) {
+  NodeId first = ast.subtreeStart(root);
+  m_flatValues.assign(root - first + 1, nullptr);
+
+  auto valueOf = [&](NodeId node) { return m_flatValues[node - first]; };
+
+  // children come before their parents, their values are always ready
+  for (NodeId node = first; node <= root; node++) {
+    Value *value = nullptr;
+
+    switch (ast.type(node)) {
+    case AstType::NumberExpr:
+      value = ConstantFP::get(*m_context, llvm::APFloat(ast.number(node)));
+      break;
+
+    case AstType::VariableExpr:
+      value = emitVariable(ast.symbol(node));
+      break;
+
+    case AstType::BinaryExpr: {
+      const FlatAst::Operands &operands = ast.operands(node);
+      value = emitBinary(ast.operation(node), valueOf(operands[0]),
+                         valueOf(operands[1]));
+      break;
+    }
+
+    case AstType::CallExpr: {
+      llvm::SmallVector<Value *, 8> args;
+      for (NodeId arg : ast.list(node))
+        args.push_back(valueOf(arg));
+      value = emitCall(ast.symbol(node), args);
+      break;
+    }
+
+    default:
+      LogError("Expected an expression.");
+      break;
+    }
+
+    if (!value)
+      return nullptr;
+
+    m_flatValues[node - first] = value;
+  }
+
+  return valueOf(root);
+}
+
+Function *Compiler::codegenFlatFunction(const FlatAst &ast, NodeId node) {
+  NodeId proto = ast.operands(node)[0];
+  NodeId body = ast.operands(node)[1];
+
+  Function *TheFunction = m_functions.lookup(ast.symbol(proto));
 
   if (!TheFunction)
-    TheFunction = static_cast<Function *>(codegen(proto));
+    TheFunction = static_cast<Function *>(codegen(ast, proto));
 
   if (!TheFunction)
     return nullptr;
 
-  m_namedValues.clear();
+  m_namedValues.pushScope();
+  auto args = ast.list(proto);
+  unsigned Idx = 0;
   for (auto &Arg : TheFunction->args())
-    m_namedValues[Arg.getName()] = &Arg;
+    m_namedValues.insert(Symbol{args[Idx++]}, &Arg);
 
   BasicBlock *BB = BasicBlock::Create(*m_context, "entry", TheFunction);
   m_builder->SetInsertPoint(BB);
 
-  codegen(body);
+  bool compiled = codegen(ast, body);
+  m_namedValues.popScope();
+
+  if (!compiled) {
+    eraseFunction(ast.symbol(proto));
+    return nullptr;
+  }
+
   verifyFunction(*TheFunction);
 
   return TheFunction;
 }
 
-Value *Compiler::visit(const ExpressionStmt &stmt) {
+Function *Compiler::codegenFlatExpressionStmt(const FlatAst &ast,
+                                              NodeId node) {
+  const PrototypeStmt *Proto = ExpressionStmt::anonymousPrototype();
 
-  auto Proto = stmt.proto.get();
-  auto Body = stmt.body.get();
-
-  Function *TheFunction = m_module->getFunction(Proto->name);
+  Function *TheFunction = m_functions.lookup(Proto->symbol);
 
   if (!TheFunction)
-    TheFunction = static_cast<Function *>(codegen(Proto));
+    TheFunction = emitPrototype(Proto->symbol, {});
 
   if (!TheFunction)
     return nullptr;
@@ -187,25 +544,150 @@ Value *Compiler::visit(const ExpressionStmt &stmt) {
   BasicBlock *BB = BasicBlock::Create(*m_context, "entry", TheFunction);
   m_builder->SetInsertPoint(BB);
 
-  m_namedValues.clear();
-  for (auto &Arg : TheFunction->args())
-    m_namedValues[std::string(Arg.getName())];
-
-  Value *RetVal = codegen(Body);
+  m_namedValues.pushScope();
+  Value *RetVal = codegenFlat(ast, ast.operands(node)[0]);
+  m_namedValues.popScope();
 
   if (RetVal) {
-    // Finish off the function.
     m_builder->CreateRet(RetVal);
-
-    // Validate the generated code, checking for consistency.
     verifyFunction(*TheFunction);
-
     return TheFunction;
   }
 
-  // Error reading body, remove function.
-  TheFunction->eraseFromParent();
+  eraseFunction(Proto->symbol);
   return nullptr;
 }
 
-Function *Compiler::visit(const IfStmt &stmt) {}
+Value *Compiler::emitVariable(Symbol name) {
+  Value *bound = m_namedValues.lookup(name);
+
+  if (!bound) {
+    LogError("Unknown variable name.");
+    return nullptr;
+  }
+
+  if (auto slot = dyn_cast<AllocaInst>(bound))
+    return m_builder->CreateLoad(slot->getAllocatedType(), slot,
+                                 Interner::get().name(name));
+  return bound;
+}
+
+Value *Compiler::emitLet(Symbol name, Value *value) {
+  // a new slot even when `name` is bound already, the new local shadows it
+  AllocaInst *slot = createSlot(name);
+  m_builder->CreateStore(value, slot);
+  m_namedValues.insert(name, slot);
+  m_sharedValues.clear();
+  return slot;
+}
+
+Value *Compiler::emitAssign(Symbol name, Value *value) {
+  Value *bound = m_namedValues.lookup(name);
+
+  if (!bound) {
+    LogError("Unknown variable name.");
+    return nullptr;
+  }
+
+  auto slot = dyn_cast<AllocaInst>(bound);
+
+  // An argument gets a slot on its first assignment, holding its value from
+  // the start of the function. Uses compiled so far keep the argument itself.
+  if (!slot) {
+    slot = createSlot(name);
+    IRBuilder<> entry(slot->getParent(), std::next(slot->getIterator()));
+    entry.CreateStore(bound, slot);
+    m_namedValues.insert(name, slot);
+  }
+
+  m_sharedValues.clear();
+  return m_builder->CreateStore(value, slot);
+}
+
+AllocaInst *Compiler::createSlot(Symbol name) {
+  BasicBlock &entry =
+      m_builder->GetInsertBlock()->getParent()->getEntryBlock();
+  IRBuilder<> builder(&entry, entry.begin());
+  return builder.CreateAlloca(Type::getDoubleTy(*m_context), nullptr,
+                              Interner::get().name(name));
+}
+
+Value *Compiler::emitBinary(TokenType operation, Value *L, Value *R) {
+  switch (operation) {
+  case TokenType::Plus:
+    return m_builder->CreateFAdd(L, R, "addtmp");
+  case TokenType::Minus:
+    return m_builder->CreateFSub(L, R, "subtmp");
+  case TokenType::Star:
+    return m_builder->CreateFMul(L, R, "multmp");
+  case TokenType::Slash:
+    return m_builder->CreateFDiv(L, R, "divtmp");
+
+  case TokenType::EqualEqual:
+    L = m_builder->CreateFCmpOEQ(L, R, "cmptmp");
+    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
+                                   "booltmp");
+  case TokenType::BangEqual:
+    L = m_builder->CreateFCmpUNE(L, R, "cmptmp");
+    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
+                                   "booltmp");
+  case TokenType::Lesser:
+    L = m_builder->CreateFCmpULT(L, R, "cmptmp");
+    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
+                                   "booltmp");
+  case TokenType::LesserEqual:
+    L = m_builder->CreateFCmpULE(L, R, "cmptmp");
+    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
+                                   "booltmp");
+  case TokenType::Greater:
+    L = m_builder->CreateFCmpUGT(L, R, "cmptmp");
+    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
+                                   "booltmp");
+  case TokenType::GreaterEqual:
+    L = m_builder->CreateFCmpUGE(L, R, "cmptmp");
+    return m_builder->CreateUIToFP(L, llvm::Type::getDoubleTy(*m_context),
+                                   "booltmp");
+
+  default:
+    LogError("Invalid binary operator");
+    return nullptr;
+  }
+}
+
+Value *Compiler::emitCall(Symbol callee, ArrayRef<Value *> args) {
+  Function *CalleeF = getFunction(callee);
+
+  if (!CalleeF) {
+    LogError("Unknown function referenced");
+    return nullptr;
+  }
+
+  if (CalleeF->arg_size() != args.size()) {
+    LogError("Incorrect number of arguments passed");
+    return nullptr;
+  }
+
+  return m_builder->CreateCall(CalleeF, args, "calltmp");
+}
+
+Function *Compiler::emitPrototype(Symbol name, ArrayRef<Symbol> args) {
+  Function *F = declare(name, args.size());
+
+  unsigned Idx = 0;
+  for (auto &Arg : F->args())
+    Arg.setName(Interner::get().name(args[Idx++]));
+
+  return F;
+}
+
+Function *Compiler::declare(Symbol name, std::size_t arity) {
+  std::vector<llvm::Type *> Doubles(arity, Type::getDoubleTy(*m_context));
+  FunctionType *FT =
+      FunctionType::get(Type::getDoubleTy(*m_context), Doubles, false);
+  Function *F = Function::Create(FT, Function::ExternalLinkage,
+                                 Interner::get().name(name), m_module.get());
+
+  m_functions.insert(name, F);
+  m_arities.insert(name, arity);
+  return F;
+}
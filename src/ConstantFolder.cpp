@@ -0,0 +1,108 @@
+#include "ConstantFolder.hpp"
+
+#include <cmath>
+
+static std::optional<double> numberOf(const Expr *expr) {
+  if (expr->type() != AstType::NumberExpr)
+    return std::nullopt;
+  return expr->as<const NumberExpr *>()->value;
+}
+
+ConstantFolder::Fold ConstantFolder::fold(TokenType operation, const Expr *left,
+                                          const Expr *right) const {
+  using Kind = Fold::Kind;
+
+  std::optional<double> l = numberOf(left);
+  std::optional<double> r = numberOf(right);
+
+  if (l && r) {
+    if (std::optional<double> value = evaluate(operation, *l, *r))
+      return {Kind::Number, *value};
+    return {};
+  }
+
+  switch (operation) {
+  case TokenType::Star:
+    if (r == 1.0)
+      return {Kind::Left};
+    if (l == 1.0)
+      return {Kind::Right};
+    if (m_fastMath && (r == 0.0 || l == 0.0))
+      return {Kind::Number, 0.0};
+    break;
+
+  case TokenType::Slash:
+    if (r == 1.0)
+      return {Kind::Left};
+    break;
+
+  case TokenType::Minus:
+    // -0 - 0 is still -0, but -0 - -0 is +0
+    if (r == 0.0 && !std::signbit(*r))
+      return {Kind::Left};
+    break;
+
+  case TokenType::Plus:
+    // but -0 + 0 is +0
+    if (m_fastMath && r == 0.0)
+      return {Kind::Left};
+    if (m_fastMath && l == 0.0)
+      return {Kind::Right};
+    break;
+
+  default:
+    break;
+  }
+
+  if (!m_fastMath || !r)
+    return {};
+
+  if (operation != TokenType::Plus && operation != TokenType::Star)
+    return {};
+
+  // (x + a) + b, (a + x) + b
+  if (left->type() != AstType::BinaryExpr)
+    return {};
+
+  auto inner = left->as<const BinaryExpr *>();
+  if (inner->operation != operation)
+    return {};
+
+  std::optional<double> constant = numberOf(inner->right());
+  if (!constant)
+    constant = numberOf(inner->left());
+  if (!constant)
+    return {};
+
+  return {Kind::Reassociate, *evaluate(operation, *constant, *r)};
+}
+
+std::optional<double> ConstantFolder::evaluate(TokenType operation,
+                                               double left, double right) {
+  // comparisons other than `==` are unordered like their IR, true when either
+  // side is NaN
+  switch (operation) {
+  case TokenType::Plus:
+    return left + right;
+  case TokenType::Minus:
+    return left - right;
+  case TokenType::Star:
+    return left * right;
+  case TokenType::Slash:
+    return left / right;
+  case TokenType::EqualEqual:
+    return left == right;
+  case TokenType::BangEqual:
+    return left != right;
+  case TokenType::Lesser:
+    return !(left >= right);
+  case TokenType::LesserEqual:
+    return !(left > right);
+  case TokenType::Greater:
+    return !(left <= right);
+  case TokenType::GreaterEqual:
+    return !(left < right);
+  default:
+    return std::nullopt;
+  }
+}
@@ -0,0 +1,38 @@
+#include "Diagnostics.hpp"
+#include "SourceManager.hpp"
+
+#include <algorithm>
+#include <string>
+
+static void printRange(std::ostream &out, const SourceRange &range) {
+  std::optional<ResolvedLoc> loc = SourceManager::get().resolve(range.begin);
+
+  if (!loc.has_value())
+    return;
+
+  std::size_t column = loc->column - 1;
+  std::size_t width = std::min<std::size_t>(
+      range.length(), loc->lineText.size() - std::min(column, loc->lineText.size()));
+
+  out << "  --> " << loc->bufferName << ':' << loc->line << ':'
+      << loc->column << '\n';
+  out << "   | " << loc->lineText << '\n';
+  out << "   | " << std::string(column, ' ')
+      << std::string(std::max<std::size_t>(width, 1), '^') << '\n';
+}
+
+void Diagnostics::print(std::ostream &out) const {
+  for (const Error &error : m_errors) {
+    out << "error: " << error.m_message << '\n';
+
+    if (error.m_range.has_value())
+      printRange(out, error.m_range.value());
+
+    if (error.m_fileLoc.has_value())
+      for (const SourceRange &range : error.m_fileLoc.value())
+        printRange(out, range);
+
+    if (error.m_tip.has_value())
+      out << "  tip: " << error.m_tip.value() << '\n';
+  }
+}
@@ -0,0 +1,227 @@
+#include "FlatAst.hpp"
+#include "AST.hpp"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/xxhash.h>
+
+#include <cassert>
+
+FlatAst FlatAst::build(const std::vector<AstPtr<Stmt>> &statements) {
+  FlatAst ast;
+  ast.m_roots.reserve(statements.size());
+
+  for (const auto &statement : statements)
+    ast.m_roots.push_back(ast.add(statement.get()));
+
+  return ast;
+}
+
+std::span<const std::uint32_t> FlatAst::list(NodeId node) const {
+  const Operands &operands = m_operands[node];
+
+  switch (m_types[node]) {
+  case AstType::CallExpr:
+  case AstType::PrototypeStmt:
+    return std::span(m_lists).subspan(operands[1], operands[2]);
+  case AstType::BlockStmt:
+    return std::span(m_lists).subspan(operands[0], operands[1]);
+  default:
+    return {};
+  }
+}
+
+NodeId FlatAst::add(const Expr *expr) {
+  struct Work {
+    const Expr *expr;
+    // first node of its subtree, set once its operands are queued
+    NodeId start;
+  };
+
+  // post-order with explicit stacks, expressions can be nested deeper than
+  // the call stack allows
+  std::vector<Work> work = {{expr, NO_NODE}};
+  std::vector<NodeId> ids;
+
+  while (!work.empty()) {
+    Work item = work.back();
+    work.pop_back();
+    NodeId start = size();
+
+    switch (item.expr->type()) {
+    case AstType::NumberExpr: {
+      auto number = static_cast<const NumberExpr *>(item.expr);
+      m_numbers.push_back(number->value);
+      ids.push_back(push(AstType::NumberExpr, start,
+                         {static_cast<std::uint32_t>(m_numbers.size() - 1)}));
+      break;
+    }
+
+    case AstType::VariableExpr: {
+      auto variable = static_cast<const VariableExpr *>(item.expr);
+      ids.push_back(push(AstType::VariableExpr, start, {variable->symbol.id}));
+      break;
+    }
+
+    case AstType::BinaryExpr: {
+      auto binary = static_cast<const BinaryExpr *>(item.expr);
+
+      if (item.start == NO_NODE) {
+        work.push_back({item.expr, start});
+        work.push_back({binary->right(), NO_NODE});
+        work.push_back({binary->left(), NO_NODE});
+        break;
+      }
+
+      NodeId right = ids.back();
+      ids.pop_back();
+      NodeId left = ids.back();
+      ids.pop_back();
+      ids.push_back(push(
+          AstType::BinaryExpr, item.start,
+          {left, right, static_cast<std::uint32_t>(binary->operation)}));
+      break;
+    }
+
+    case AstType::CallExpr: {
+      auto call = static_cast<const CallExpr *>(item.expr);
+
+      if (item.start == NO_NODE) {
+        work.push_back({item.expr, start});
+        for (auto arg = call->args.rbegin(); arg != call->args.rend(); ++arg)
+          work.push_back({arg->get(), NO_NODE});
+        break;
+      }
+
+      auto args = std::span(ids).last(call->args.size());
+      std::uint32_t begin = pushList(args);
+      ids.resize(ids.size() - args.size());
+      ids.push_back(push(AstType::CallExpr, item.start,
+                         {call->calleeSymbol.id, begin,
+                          static_cast<std::uint32_t>(call->args.size())}));
+      break;
+    }
+
+    default:
+      assert(false && "not an expression");
+      return NO_NODE;
+    }
+  }
+
+  return ids.back();
+}
+
+NodeId FlatAst::add(const Stmt *stmt) {
+  NodeId start = size();
+
+  switch (stmt->type()) {
+  case AstType::PrototypeStmt: {
+    auto proto = static_cast<const PrototypeStmt *>(stmt);
+    llvm::SmallVector<std::uint32_t, 8> args;
+    for (Symbol arg : proto->argSymbols)
+      args.push_back(arg.id);
+
+    std::uint32_t begin = pushList(args);
+    return push(AstType::PrototypeStmt, start,
+                {proto->symbol.id, begin,
+                 static_cast<std::uint32_t>(args.size())});
+  }
+
+  case AstType::FunctionStmt: {
+    auto function = static_cast<const FunctionStmt *>(stmt);
+    NodeId proto = add(function->proto.get());
+    NodeId body = add(function->body.get());
+    return push(AstType::FunctionStmt, start, {proto, body});
+  }
+
+  case AstType::BlockStmt: {
+    auto block = static_cast<const BlockStmt *>(stmt);
+    llvm::SmallVector<std::uint32_t, 8> statements;
+    for (const auto &statement : block->statements)
+      statements.push_back(add(statement.get()));
+
+    NodeId returnStmt =
+        block->returnStmt ? add(block->returnStmt.get()) : NO_NODE;
+
+    std::uint32_t begin = pushList(statements);
+    return push(AstType::BlockStmt, start,
+                {begin, static_cast<std::uint32_t>(statements.size()),
+                 returnStmt});
+  }
+
+  case AstType::ReturnStmt: {
+    auto returnStmt = static_cast<const ReturnStmt *>(stmt);
+    NodeId value = returnStmt->returnValue
+                       ? add(returnStmt->returnValue.get())
+                       : NO_NODE;
+    return push(AstType::ReturnStmt, start, {value});
+  }
+
+  case AstType::ExpressionStmt: {
+    auto expression = static_cast<const ExpressionStmt *>(stmt);
+    NodeId body = add(expression->body.get());
+    return push(AstType::ExpressionStmt, start, {body});
+  }
+
+  case AstType::LetStmt: {
+    auto let = static_cast<const LetStmt *>(stmt);
+    NodeId value = add(let->value.get());
+    return push(AstType::LetStmt, start, {let->symbol.id, value});
+  }
+
+  case AstType::AssignStmt: {
+    auto assign = static_cast<const AssignStmt *>(stmt);
+    NodeId value = add(assign->value.get());
+    return push(AstType::AssignStmt, start, {assign->symbol.id, value});
+  }
+
+  case AstType::IfStmt: {
+    auto ifStmt = static_cast<const IfStmt *>(stmt);
+    NodeId condition = add(ifStmt->condition.get());
+    NodeId thenBlock = add(ifStmt->thenBlock.get());
+    NodeId elseIf = ifStmt->elseIf ? add(ifStmt->elseIf.get()) : NO_NODE;
+    NodeId elseBlock =
+        ifStmt->elseBlock ? add(ifStmt->elseBlock.get()) : NO_NODE;
+    return push(AstType::IfStmt, start,
+                {condition, thenBlock, elseIf, elseBlock});
+  }
+
+  default:
+    assert(false && "not a statement");
+    return NO_NODE;
+  }
+}
+
+NodeId FlatAst::push(AstType type, NodeId subtreeStart, Operands operands) {
+  m_types.push_back(type);
+  m_subtreeStarts.push_back(subtreeStart);
+  m_operands.push_back(operands);
+  return static_cast<NodeId>(m_types.size() - 1);
+}
+
+std::uint32_t FlatAst::pushList(std::span<const std::uint32_t> items) {
+  std::uint32_t begin = m_lists.size();
+  m_lists.insert(m_lists.end(), items.begin(), items.end());
+  return begin;
+}
+
+template <typename T> static std::uint64_t hashArray(const std::vector<T> &v) {
+  return llvm::xxHash64(llvm::ArrayRef<std::uint8_t>(
+      reinterpret_cast<const std::uint8_t *>(v.data()), v.size() * sizeof(T)));
+}
+
+std::uint64_t FlatAst::hash() const {
+  std::vector<std::uint64_t> hashes = {
+      hashArray(m_types),   hashArray(m_subtreeStarts), hashArray(m_operands),
+      hashArray(m_numbers), hashArray(m_lists),         hashArray(m_roots),
+  };
+  return hashArray(hashes);
+}
+
+std::size_t FlatAst::bytesUsed() const {
+  return m_types.capacity() * sizeof(AstType) +
+         m_subtreeStarts.capacity() * sizeof(NodeId) +
+         m_operands.capacity() * sizeof(Operands) +
+         m_numbers.capacity() * sizeof(double) +
+         m_lists.capacity() * sizeof(std::uint32_t) +
+         m_roots.capacity() * sizeof(NodeId);
+}
@@ -0,0 +1,61 @@
+#include "HashCons.hpp"
+
+#include <llvm/ADT/Hashing.h>
+
+#include <bit>
+
+Expr *HashConsTable::find(const ExprKey &key) {
+  auto [begin, end] = m_nodes.equal_range(hash(key));
+
+  for (auto entry = begin; entry != end; ++entry) {
+    if (matches(key, entry->second)) {
+      m_hits += 1;
+      return entry->second;
+    }
+  }
+
+  return nullptr;
+}
+
+std::size_t HashConsTable::hash(const ExprKey &key) {
+  return llvm::hash_combine(
+      static_cast<std::uint8_t>(key.type),
+      static_cast<std::uint8_t>(key.operation), key.value,
+      llvm::hash_combine_range(key.children.begin(), key.children.end()));
+}
+
+bool HashConsTable::matches(const ExprKey &key, const Expr *expr) {
+  if (expr->type() != key.type)
+    return false;
+
+  switch (key.type) {
+  case AstType::NumberExpr:
+    return std::bit_cast<std::uint64_t>(expr->as<const NumberExpr *>()->value) ==
+           key.value;
+
+  case AstType::VariableExpr:
+    return expr->as<const VariableExpr *>()->symbol.id == key.value;
+
+  case AstType::BinaryExpr: {
+    auto binary = expr->as<const BinaryExpr *>();
+    return binary->operation == key.operation &&
+           binary->left() == key.children[0] &&
+           binary->right() == key.children[1];
+  }
+
+  case AstType::CallExpr: {
+    auto call = expr->as<const CallExpr *>();
+    if (call->calleeSymbol.id != key.value ||
+        call->args.size() != key.children.size())
+      return false;
+
+    for (std::size_t i = 0; i < call->args.size(); i++)
+      if (call->args[i].get() != key.children[i])
+        return false;
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,85 @@
+#include "IncrementalParser.hpp"
+#include "Parser.hpp"
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/xxhash.h>
+
+#include <unordered_map>
+#include <utility>
+
+IncrementalParser::Update
+IncrementalParser::update(const TokenBuffer &tokens) {
+  // the trailing `Eof` belongs to no span, appending a span must not change
+  // the one that used to be last
+  std::size_t end = tokens.size();
+  if (end > 0 && tokens.type(end - 1) == TokenType::Eof)
+    end -= 1;
+
+  std::vector<std::size_t> boundaries =
+      Parser::topLevelBoundaries(tokens, 0, end, 1);
+
+  std::unordered_multimap<std::uint64_t, std::size_t> reusable;
+  std::size_t previousStatements = 0;
+  for (std::size_t i = 0; i < m_spans.size(); i++) {
+    previousStatements += m_spans[i].statements.size();
+    if (!m_spans[i].diagnostics.hasErrors())
+      reusable.emplace(m_spans[i].fingerprint, i);
+  }
+
+  Update update;
+  std::vector<Span> spans;
+  std::size_t statementCount = 0;
+  std::size_t reusedStatements = 0;
+
+  for (std::size_t i = 0; i + 1 < boundaries.size(); i++) {
+    std::uint64_t hash = fingerprint(tokens, boundaries[i], boundaries[i + 1]);
+
+    auto found = reusable.find(hash);
+    if (found != reusable.end()) {
+      spans.push_back(std::move(m_spans[found->second]));
+      reusable.erase(found);
+
+      update.reusedSpans += 1;
+      reusedStatements += spans.back().statements.size();
+      statementCount += spans.back().statements.size();
+      continue;
+    }
+
+    Parser parser = Parser(tokens, boundaries[i], boundaries[i + 1]);
+    Span span = {hash, parser.parse(), parser.diagnostics()};
+
+    for (std::size_t j = 0; j < span.statements.size(); j++)
+      update.changed.push_back(statementCount + j);
+
+    update.parsedSpans += 1;
+    statementCount += span.statements.size();
+    spans.push_back(std::move(span));
+  }
+
+  update.removed = previousStatements - reusedStatements;
+
+  // spans that were not reused are freed here
+  m_spans = std::move(spans);
+
+  m_statements.clear();
+  m_statements.reserve(statementCount);
+  m_diagnostics.clear();
+
+  for (const Span &span : m_spans) {
+    for (const auto &statement : span.statements)
+      m_statements.push_back(statement.get());
+    m_diagnostics.append(span.diagnostics);
+  }
+
+  return update;
+}
+
+std::uint64_t IncrementalParser::fingerprint(const TokenBuffer &tokens,
+                                             std::size_t begin,
+                                             std::size_t end) {
+  // The text spanned by the tokens determines them, hashing it in one go is
+  // much cheaper than hashing token by token. Whitespace and comment changes
+  // inside a span make it parse again, which is harmless.
+  std::string_view text = tokens.text(begin, end);
+  return llvm::xxHash64(llvm::StringRef(text.data(), text.size()));
+}
@@ -0,0 +1,45 @@
+#include "Interner.hpp"
+
+#include <cassert>
+#include <mutex>
+
+Interner &Interner::get() {
+  static Interner interner;
+  return interner;
+}
+
+Symbol Interner::intern(std::string_view name) {
+  {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto found = m_symbols.find(llvm::StringRef(name.data(), name.size()));
+    if (found != m_symbols.end())
+      return found->second;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+  Symbol symbol = {static_cast<std::uint32_t>(m_names.size())};
+  auto [entry, inserted] = m_symbols.try_emplace(
+      llvm::StringRef(name.data(), name.size()), symbol);
+
+  // another thread interned it in the meantime
+  if (!inserted)
+    return entry->second;
+
+  // StringMap entries never move, their keys are stable
+  llvm::StringRef key = entry->first();
+  m_names.push_back(std::string_view(key.data(), key.size()));
+
+  return symbol;
+}
+
+std::string_view Interner::name(Symbol symbol) const {
+  std::shared_lock<std::shared_mutex> lock(m_mutex);
+  assert(symbol.id < m_names.size());
+  return m_names[symbol.id];
+}
+
+std::size_t Interner::size() const {
+  std::shared_lock<std::shared_mutex> lock(m_mutex);
+  return m_names.size();
+}
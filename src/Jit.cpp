@@ -0,0 +1,196 @@
+#include "Jit.hpp"
+#include "Logger.hpp"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <mutex>
+
+using namespace llvm;
+
+static void report(Error error) {
+  LogError(toString(std::move(error)).c_str());
+}
+
+namespace {
+// Serves the compile layer from an ObjectCache. Modules are optimized before
+// they are added, so they are compiled as they are.
+class CompileLayerCache : public llvm::ObjectCache {
+private:
+  ::ObjectCache &m_cache;
+  std::string m_salt;
+
+  // keys of the modules being compiled, modules may compile concurrently
+  std::mutex m_mutex;
+  DenseMap<const Module *, std::uint64_t> m_keys;
+
+public:
+  CompileLayerCache(::ObjectCache &cache, std::string salt)
+      : m_cache(cache), m_salt(std::move(salt)){};
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module *module) override {
+    std::uint64_t key = ::ObjectCache::key(*module, m_salt);
+    if (auto object = m_cache.lookup(key))
+      return object;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keys[module] = key;
+    return nullptr;
+  }
+
+  void notifyObjectCompiled(const Module *module,
+                            MemoryBufferRef object) override {
+    std::uint64_t key;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto entry = m_keys.find(module);
+      if (entry == m_keys.end())
+        return;
+      key = entry->second;
+      m_keys.erase(entry);
+    }
+
+    m_cache.store(key, object);
+  }
+};
+} // namespace
+
+std::unique_ptr<Jit> Jit::create(OptLevel level, ::ObjectCache *cache) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  // the host's CPU name and features, not just its triple
+  auto machine = orc::JITTargetMachineBuilder::detectHost();
+  if (!machine) {
+    report(machine.takeError());
+    return nullptr;
+  }
+  machine->setCodeGenOptLevel(codeGenOptLevel(level));
+
+  auto targetMachine = machine->createTargetMachine();
+  if (!targetMachine) {
+    report(targetMachine.takeError());
+    return nullptr;
+  }
+
+  std::unique_ptr<CompileLayerCache> objectCache;
+  if (cache)
+    objectCache = std::make_unique<CompileLayerCache>(
+        *cache, ::ObjectCache::describe(**targetMachine, level) + " as is");
+
+  auto jit =
+      orc::LLJITBuilder()
+          .setJITTargetMachineBuilder(*machine)
+          .setCompileFunctionCreator(
+              [objectCache = objectCache.get()](
+                  orc::JITTargetMachineBuilder builder)
+                  -> Expected<std::unique_ptr<orc::IRCompileLayer::IRCompiler>> {
+                auto machine = builder.createTargetMachine();
+                if (!machine)
+                  return machine.takeError();
+                return std::make_unique<orc::TMOwningSimpleCompiler>(
+                    std::move(*machine), objectCache);
+              })
+          .create();
+  if (!jit) {
+    report(jit.takeError());
+    return nullptr;
+  }
+
+  // calls to functions that are not defined resolve to the process, e.g. libm
+  auto process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*jit)->getDataLayout().getGlobalPrefix());
+  if (!process) {
+    report(process.takeError());
+    return nullptr;
+  }
+  (*jit)->getMainJITDylib().addGenerator(std::move(*process));
+
+  return std::unique_ptr<Jit>(new Jit(std::move(objectCache), std::move(*jit),
+                                      std::move(*machine),
+                                      std::move(*targetMachine)));
+}
+
+bool Jit::add(orc::ThreadSafeModule module) {
+  prepare(module);
+
+  if (Error error = m_jit->addIRModule(std::move(module))) {
+    report(std::move(error));
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<TargetMachine> Jit::createTargetMachine() const {
+  // a copy, callers may be on several threads
+  orc::JITTargetMachineBuilder builder = m_machineBuilder;
+  auto machine = builder.createTargetMachine();
+  if (!machine) {
+    report(machine.takeError());
+    return nullptr;
+  }
+  return std::move(*machine);
+}
+
+bool Jit::addObject(std::unique_ptr<MemoryBuffer> object) {
+  if (Error error = m_jit->addObjectFile(std::move(object))) {
+    report(std::move(error));
+    return false;
+  }
+  return true;
+}
+
+bool Jit::addObjects(std::vector<std::unique_ptr<MemoryBuffer>> objects) {
+  auto tracker = m_jit->getMainJITDylib().createResourceTracker();
+
+  for (auto &object : objects) {
+    if (Error error = m_jit->addObjectFile(tracker, std::move(object))) {
+      report(std::move(error));
+      // the objects added so far go again, nothing has run from them yet
+      if (Error removed = tracker->remove())
+        report(std::move(removed));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::optional<double> Jit::evaluate(orc::ThreadSafeModule module,
+                                    Symbol name) {
+  prepare(module);
+
+  auto tracker = m_jit->getMainJITDylib().createResourceTracker();
+
+  if (Error error = m_jit->addIRModule(tracker, std::move(module))) {
+    report(std::move(error));
+    return std::nullopt;
+  }
+
+  std::optional<double> result;
+
+  if (void *address = lookup(name))
+    result = reinterpret_cast<double (*)()>(address)();
+
+  if (Error error = tracker->remove())
+    report(std::move(error));
+
+  return result;
+}
+
+void *Jit::lookup(Symbol name) {
+  auto symbol = m_jit->lookup(Interner::get().name(name));
+  if (!symbol) {
+    report(symbol.takeError());
+    return nullptr;
+  }
+  return reinterpret_cast<void *>(symbol->getAddress());
+}
+
+void Jit::prepare(orc::ThreadSafeModule &module) {
+  module.withModuleDo(
+      [&](Module &m) { m.setDataLayout(m_jit->getDataLayout()); });
+}
@@ -1,124 +1,372 @@
 #include "Lexer.hpp"
+#include "CharScan.hpp"
 #include "Error.hpp"
 #include "Token.hpp"
 
-#include <cctype>
+#include <algorithm>
 #include <charconv>
 #include <cstring>
+#include <future>
 #include <optional>
 #include <vector>
 
-#include <map>
+#include <array>
 
-const static std::map<std::string_view, TokenType> KEYWORDS = {
+struct Keyword {
+  std::string_view lexeme;
+  TokenType type = TokenType::Identifier;
+};
+
+constexpr std::array<Keyword, 11> KEYWORDS = {{
     {"and", TokenType::And},       {"or", TokenType::Or},
     {"def", TokenType::Def},       {"if", TokenType::If},
     {"elif", TokenType::ElseIf},   {"else", TokenType::Else},
     {"then", TokenType::Then},     {"let", TokenType::Let},
     {"end", TokenType::End},       {"extern", TokenType::Extern},
     {"return", TokenType::Return},
-};
+}};
+
+constexpr std::size_t KEYWORD_MIN_LENGTH = 2;
+constexpr std::size_t KEYWORD_MAX_LENGTH = 6;
+constexpr std::size_t KEYWORD_SLOTS = 32;
+
+// Perfect hash over the keyword set: length, first and last character are
+// enough to give every keyword its own slot.
+constexpr std::size_t keywordHash(std::string_view word) {
+  return (word.size() + 2 * (static_cast<unsigned char>(word.front()) +
+                             static_cast<unsigned char>(word.back()))) &
+         (KEYWORD_SLOTS - 1);
+}
+
+constexpr std::array<Keyword, KEYWORD_SLOTS> makeKeywordTable() {
+  std::array<Keyword, KEYWORD_SLOTS> table = {};
+  for (const Keyword &keyword : KEYWORDS)
+    table[keywordHash(keyword.lexeme)] = keyword;
+  return table;
+}
+
+constexpr std::array<Keyword, KEYWORD_SLOTS> KEYWORD_TABLE = makeKeywordTable();
+
+constexpr bool isPerfectKeywordHash() {
+  for (const Keyword &keyword : KEYWORDS) {
+    if (KEYWORD_TABLE[keywordHash(keyword.lexeme)].lexeme != keyword.lexeme)
+      return false;
+    if (keyword.lexeme.size() < KEYWORD_MIN_LENGTH ||
+        keyword.lexeme.size() > KEYWORD_MAX_LENGTH)
+      return false;
+  }
+  return true;
+}
+
+static_assert(isPerfectKeywordHash(),
+              "keywords collide in KEYWORD_TABLE, adjust keywordHash");
+
+// returns the keyword type of `word` or `TokenType::Identifier`, without
+// allocating or throwing
+constexpr TokenType classifyIdentifier(std::string_view word) {
+  if (word.size() < KEYWORD_MIN_LENGTH || word.size() > KEYWORD_MAX_LENGTH)
+    return TokenType::Identifier;
+
+  const Keyword &slot = KEYWORD_TABLE[keywordHash(word)];
+  return slot.lexeme == word ? slot.type : TokenType::Identifier;
+}
+
+static_assert(classifyIdentifier("elif") == TokenType::ElseIf);
+static_assert(classifyIdentifier("elf") == TokenType::Identifier);
 
 std::vector<Token> Lexer::scanTokens() {
 
   std::vector<Token> tokens;
 
+  while (true) {
+    tokens.push_back(nextToken());
+    if (tokens.back().m_type == TokenType::Eof)
+      break;
+  };
+
+  return tokens;
+}
+
+Token Lexer::nextToken() {
+
   while (!isFinished()) {
     m_start = m_current;
 
-    try {
-      std::optional<Token> token = scanSingleToken();
-      if (token.has_value())
-        tokens.push_back(token.value());
-    } catch (Error e) {
-      std::cout << e.m_message << '\n';
-    }
+    std::optional<Token> token = scanSingleToken();
+    if (token.has_value())
+      return token.value();
   };
 
-  tokens.push_back(Token(TokenType::Eof, std::nullopt, computeLineLocation()));
+  m_start = m_current;
+  return Token(TokenType::Eof, std::nullopt, computeRange());
+}
+
+struct LexedChunk {
+  std::size_t start;
+  std::size_t end;
+  std::vector<Token> tokens;
+  Diagnostics diagnostics;
+  bool endsInsideString;
+};
+
+static LexedChunk lexChunk(std::string_view source, SourceLoc base,
+                           std::size_t start, std::size_t end) {
+  LexedChunk chunk = {start, end, {}, {}, false};
+
+  Lexer lexer = Lexer(source.substr(start, end - start), &chunk.diagnostics,
+                      base + start);
+  chunk.tokens = lexer.scanTokens();
+  chunk.endsInsideString = lexer.endedInsideString();
+
+  return chunk;
+}
+
+std::vector<Token> Lexer::scanTokensParallel(std::string_view source,
+                                             ThreadPool &pool,
+                                             Diagnostics *diagnostics,
+                                             SourceLoc base,
+                                             std::size_t chunkSize) {
+  // Chunks start right after a newline. No token other than a string literal
+  // spans a newline and comments stop at one, so every boundary is a place
+  // the serial lexer could also start from unless a string is still open.
+  std::vector<std::size_t> boundaries = {0};
+  const char *end = source.data() + source.size();
+
+  while (source.size() - boundaries.back() > chunkSize) {
+    const char *target = source.data() + boundaries.back() + chunkSize;
+    const char *newline = findNewline(target, end);
+
+    if (newline == end)
+      break;
+
+    boundaries.push_back(newline + 1 - source.data());
+  }
+  boundaries.push_back(source.size());
+
+  std::vector<std::future<LexedChunk>> pending;
+  for (std::size_t i = 0; i + 1 < boundaries.size(); i++) {
+    std::size_t start = boundaries[i];
+    std::size_t end = boundaries[i + 1];
+
+    pending.push_back(pool.submit([source, base, start, end]() {
+      return lexChunk(source, base, start, end);
+    }));
+  }
+
+  std::vector<LexedChunk> chunks;
+  for (std::size_t i = 0; i < pending.size(); i++) {
+    LexedChunk next = pending[i].get();
+
+    // The previous chunk ran into the end of its slice inside a string, so
+    // this one was lexed from the wrong state. Lex both again as one chunk.
+    if (!chunks.empty() && chunks.back().endsInsideString) {
+      next = lexChunk(source, base, chunks.back().start, next.end);
+      chunks.pop_back();
+    }
+
+    chunks.push_back(std::move(next));
+  }
+
+  std::size_t count = 1;
+  for (const LexedChunk &chunk : chunks)
+    count += chunk.tokens.size() - 1;
+
+  std::vector<Token> tokens;
+  tokens.reserve(count);
+  Diagnostics errors;
+
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    // every chunk but the last one ends with an `Eof` that has to go
+    auto last = chunks[i].tokens.end() - (i + 1 < chunks.size() ? 1 : 0);
+    tokens.insert(tokens.end(), chunks[i].tokens.begin(), last);
+    errors.append(chunks[i].diagnostics);
+  }
+
+  if (diagnostics)
+    diagnostics->append(errors);
 
   return tokens;
 }
 
+// moves a token that was not rescanned to its place in the edited source
+static void rebaseToken(Token &token, std::int64_t shift,
+                        std::string_view source, SourceLoc base) {
+  token.m_range.begin.offset += shift;
+  token.m_range.end.offset += shift;
+
+  // lexemes have to point into the new text
+  if (token.m_type == TokenType::Identifier ||
+      token.m_type == TokenType::String)
+    token.m_value = source.substr(token.m_range.begin.offset - base.offset,
+                                  token.m_range.length());
+}
+
+void Lexer::relex(std::vector<Token> &tokens, SourceLoc previousBase,
+                  std::string_view source, SourceLoc base,
+                  const TextEdit &edit, Diagnostics *diagnostics) {
+  std::int64_t delta = std::int64_t(edit.inserted.size()) - edit.removed;
+  std::size_t editEnd = edit.offset + edit.removed;
+
+  auto offsetOf = [previousBase](const Token &token) {
+    return std::size_t(token.m_range.begin.offset - previousBase.offset);
+  };
+
+  // Numbers look two characters past their end, so start over from the token
+  // before the first one that ends within reach of the edit.
+  auto reach = std::partition_point(
+      tokens.begin(), tokens.end(), [&](const Token &token) {
+        return token.m_type != TokenType::Eof &&
+               token.m_range.end.offset - previousBase.offset + 2 <
+                   edit.offset;
+      });
+
+  std::size_t first = reach - tokens.begin();
+  std::size_t restart = 0;
+
+  // restart at a token boundary, anything in between may be a comment
+  if (first > 0) {
+    first--;
+    restart = offsetOf(tokens[first]);
+    // a string's range starts after its opening quote
+    if (tokens[first].m_type == TokenType::String)
+      restart -= 1;
+  }
+
+  // tokens before the restart point keep their offsets
+  for (std::size_t i = 0; i < first; i++)
+    rebaseToken(tokens[i], std::int64_t(base.offset) - previousBase.offset,
+                source, base);
+
+  Lexer lexer = Lexer(source, diagnostics, base);
+  lexer.m_current = restart;
+
+  // old token to try and synchronize with next
+  std::size_t old = first;
+  std::vector<Token> rescanned;
+
+  while (true) {
+    Token token = lexer.nextToken();
+    std::size_t offset = token.m_range.begin.offset - base.offset;
+
+    if (offset >= edit.offset + edit.inserted.size()) {
+      while (old < tokens.size() &&
+             (offsetOf(tokens[old]) < editEnd ||
+              std::int64_t(offsetOf(tokens[old])) + delta <
+                  std::int64_t(offset)))
+        old++;
+
+      // The new token starts at the same text as an old one, so everything
+      // from here on lexes exactly as before. Strings start after their
+      // opening quote, so the types have to agree as well.
+      if (old < tokens.size() &&
+          std::int64_t(offsetOf(tokens[old])) + delta ==
+              std::int64_t(offset) &&
+          tokens[old].m_type == token.m_type)
+        break;
+    }
+
+    rescanned.push_back(token);
+
+    if (token.m_type == TokenType::Eof) {
+      old = tokens.size();
+      break;
+    }
+  }
+
+  std::int64_t shift = std::int64_t(base.offset) - previousBase.offset + delta;
+  for (std::size_t i = old; i < tokens.size(); i++)
+    rebaseToken(tokens[i], shift, source, base);
+
+  // splice the rescanned tokens over the damaged ones
+  std::size_t damaged = old - first;
+  if (rescanned.size() <= damaged) {
+    std::copy(rescanned.begin(), rescanned.end(), tokens.begin() + first);
+    tokens.erase(tokens.begin() + first + rescanned.size(),
+                 tokens.begin() + old);
+  } else {
+    std::copy(rescanned.begin(), rescanned.begin() + damaged,
+              tokens.begin() + first);
+    tokens.insert(tokens.begin() + old, rescanned.begin() + damaged,
+                  rescanned.end());
+  }
+}
+
 std::optional<Token> Lexer::scanSingleToken() {
   char c = advance();
 
   switch (c) {
   case '\n':
-    m_line += 1;
-    return std::nullopt;
   case ' ':
   case '\r':
   case '\t':
+    // deep indentation and blank lines are skipped a vector at a time
+    jumpTo(skipWhitespace(cursor(), sourceEnd()));
     return std::nullopt;
   case '(':
-    return Token(TokenType::LeftParen, std::nullopt, computeLineLocation());
+    return Token(TokenType::LeftParen, std::nullopt, computeRange());
   case ')':
-    return Token(TokenType::RightParen, std::nullopt, computeLineLocation());
+    return Token(TokenType::RightParen, std::nullopt, computeRange());
   case '+':
-    return Token(TokenType::Plus, std::nullopt, computeLineLocation());
+    return Token(TokenType::Plus, std::nullopt, computeRange());
   case '-':
-    return Token(TokenType::Minus, std::nullopt, computeLineLocation());
+    return Token(TokenType::Minus, std::nullopt, computeRange());
   case ',':
-    return Token(TokenType::Comma, std::nullopt, computeLineLocation());
+    return Token(TokenType::Comma, std::nullopt, computeRange());
   case '/':
     if (match('/')) {
-      while (peek() != '\n' && peek() != '\0')
-        advance();
+      jumpTo(findNewline(cursor(), sourceEnd()));
       return std::nullopt;
     }
-    return Token(TokenType::Slash, std::nullopt, computeLineLocation());
+    return Token(TokenType::Slash, std::nullopt, computeRange());
   case '*':
-    return Token(TokenType::Star, std::nullopt, computeLineLocation());
+    return Token(TokenType::Star, std::nullopt, computeRange());
   case '!':
     if (match('='))
-      return Token(TokenType::BangEqual, std::nullopt, computeLineLocation());
+      return Token(TokenType::BangEqual, std::nullopt, computeRange());
 
-    return Token(TokenType::Bang, std::nullopt, computeLineLocation());
+    return Token(TokenType::Bang, std::nullopt, computeRange());
   case '>':
     if (match('='))
       return Token(TokenType::GreaterEqual, std::nullopt,
-                   computeLineLocation());
+                   computeRange());
 
-    return Token(TokenType::Greater, std::nullopt, computeLineLocation());
+    return Token(TokenType::Greater, std::nullopt, computeRange());
   case '<':
     if (match('='))
-      return Token(TokenType::LesserEqual, std::nullopt, computeLineLocation());
+      return Token(TokenType::LesserEqual, std::nullopt, computeRange());
 
-    return Token(TokenType::Lesser, std::nullopt, computeLineLocation());
+    return Token(TokenType::Lesser, std::nullopt, computeRange());
   case '=':
     if (match('='))
-      return Token(TokenType::EqualEqual, std::nullopt, computeLineLocation());
+      return Token(TokenType::EqualEqual, std::nullopt, computeRange());
 
-    return Token(TokenType::Equal, std::nullopt, computeLineLocation());
+    return Token(TokenType::Equal, std::nullopt, computeRange());
   case '"':
     return scanString();
   default:
-    if (std::isalpha(c) || c == '_') {
+    if (isIdentifierStart(c)) {
       return scanIdentifier();
-    } else if (std::isdigit(c)) {
+    } else if (isDigit(c)) {
       return scanNumber();
     } else {
-      // TODO use libfmt to fix this mess
-      throw Error("Unexpected character")
-          .setLineLoc(m_current - 1, m_current - 1, m_line);
+      // skip the character and keep scanning
+      diagnostics().report(Error("Unexpected character")
+                               .setRange(rangeOf(m_current - 1, m_current)));
     }
   }
   return std::nullopt;
 }
 
-Token Lexer::scanString() {
-  while (peek() != '"' && !isFinished()) {
-    if (peek() == '\n')
-      m_line += 1;
-
+std::optional<Token> Lexer::scanString() {
+  while (peek() != '"' && !isFinished())
     advance();
-  }
 
   if (isFinished()) {
-    throw Error("Unterminated string")
-        .setLineLoc(m_current - 1, m_current - 1, m_line)
-        .setTip("Consider placing an enclosing \"");
+    m_unterminatedString = true;
+    diagnostics().report(Error("Unterminated string")
+                             .setRange(computeRange())
+                             .setTip("Consider placing an enclosing \""));
+    return std::nullopt;
   }
 
   advance();
@@ -127,42 +375,37 @@ Token Lexer::scanString() {
       m_source.substr(m_start + 1, m_current - m_start - 2);
 
   return Token(TokenType::String, substring,
-               LineLoc(m_start + 1, m_current - 1, m_line));
+               rangeOf(m_start + 1, m_current - 1));
 }
 
 Token Lexer::scanIdentifier() {
-  while (std::isalnum(peek()) || peek() == '_')
-    advance();
+  jumpTo(skipIdentifier(cursor(), sourceEnd()));
 
   std::string_view keyword = m_source.substr(m_start, m_current - m_start);
   // TODO: support else if, not elif by looking ahead
 
-  TokenType type;
-  try {
-    type = KEYWORDS.at(keyword);
-    return Token(type, std::nullopt, LineLoc(m_start, m_current, m_line));
-  } catch (std::out_of_range e) {
-    type = TokenType::Identifier;
-    // pass lexeme to the keyword which will be used to reference a variable
-    return Token(type, keyword, LineLoc(m_start, m_current, m_line));
-  }
+  TokenType type = classifyIdentifier(keyword);
+
+  if (type != TokenType::Identifier)
+    return Token(type, std::nullopt, computeRange());
+
+  // pass lexeme to the keyword which will be used to reference a variable
+  return Token(type, keyword, computeRange());
 }
 Token Lexer::scanNumber() {
-  while (std::isdigit(peek()))
-    advance();
+  jumpTo(skipDigits(cursor(), sourceEnd()));
 
-  if (peek() == '.' && std::isdigit(peekNext())) {
+  if (peek() == '.' && isDigit(peekNext())) {
     advance();
 
-    while (std::isdigit(peek()))
-      advance();
+    jumpTo(skipDigits(cursor(), sourceEnd()));
   }
 
   double num;
   std::string_view string_lexeme =
-      m_source.substr(m_start, m_start - m_current);
+      m_source.substr(m_start, m_current - m_start);
   std::from_chars(string_lexeme.data(),
                   string_lexeme.data() + string_lexeme.size(), num);
 
-  return Token(TokenType::Number, num, LineLoc(m_start, m_current, m_line));
+  return Token(TokenType::Number, num, computeRange());
 }
@@ -0,0 +1,180 @@
+#include "ObjectCache.hpp"
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::string_view EXTENSION = ".o";
+// in `<key>.o.tmp.<pid>.<thread>`
+constexpr std::string_view TEMPORARY = ".o.tmp.";
+// no write takes this long, a temporary file this old lost its writer
+constexpr auto STALE_TEMPORARY_AGE = std::chrono::minutes(10);
+} // namespace
+
+ObjectCache::ObjectCache(std::string directory, std::uint64_t maxBytes)
+    : m_directory(std::move(directory)), m_maxBytes(maxBytes) {
+  std::error_code error;
+  fs::create_directories(m_directory, error);
+}
+
+std::uint64_t ObjectCache::key(const llvm::Module &module,
+                               std::string_view salt) {
+  std::string text(salt);
+  text += '\n';
+
+  llvm::raw_string_ostream stream(text);
+  module.print(stream, nullptr);
+  stream.flush();
+
+  return llvm::xxHash64(llvm::StringRef(text));
+}
+
+std::string ObjectCache::describe(const llvm::TargetMachine &machine,
+                                  OptLevel level) {
+  return "PolyLang " + std::to_string(VERSION) + " LLVM " LLVM_VERSION_STRING
+         " " + machine.getTargetTriple().str() + " " +
+         machine.getTargetCPU().str() + " " +
+         machine.getTargetFeatureString().str() + " -O" +
+         std::to_string(static_cast<int>(level));
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ObjectCache::lookup(std::uint64_t key) {
+  std::string path = pathFor(key);
+  auto object = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (!object) {
+    m_misses += 1;
+    return nullptr;
+  }
+
+  // a truncated or otherwise damaged file would fail every later run too
+  auto parsed = llvm::object::ObjectFile::createObjectFile(**object);
+  if (!parsed) {
+    llvm::consumeError(parsed.takeError());
+    std::error_code error;
+    fs::remove(path, error);
+    m_misses += 1;
+    return nullptr;
+  }
+
+  // eviction goes by modification time, a hit makes the object recent again
+  std::error_code error;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+  m_hits += 1;
+  return std::move(*object);
+}
+
+bool ObjectCache::store(std::uint64_t key, llvm::MemoryBufferRef object) {
+  std::string path = pathFor(key);
+  // unique across processes and their threads
+  std::string temporary =
+      path + ".tmp." + std::to_string(::getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+  int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+
+  bool written;
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/false);
+    out << object.getBuffer();
+    out.flush();
+    written = !out.has_error();
+    // the stream aborts on destruction with an error left unhandled
+    out.clear_error();
+  }
+
+  // the rename must not reach the disk before the contents do
+  written = ::fsync(fd) == 0 && written;
+  written = ::close(fd) == 0 && written;
+
+  if (!written) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+
+  evict();
+  return true;
+}
+
+void ObjectCache::evict() {
+  struct Entry {
+    fs::path path;
+    fs::file_time_type used;
+    std::uint64_t size;
+  };
+
+  std::vector<Entry> entries;
+  std::uint64_t total = 0;
+  std::error_code error;
+
+  auto now = fs::file_time_type::clock::now();
+
+  for (const auto &file : fs::directory_iterator(m_directory, error)) {
+    std::string name = file.path().filename().string();
+    if (name.find(TEMPORARY) != std::string::npos) {
+      std::error_code staleError;
+      auto written = file.last_write_time(staleError);
+      if (!staleError && now - written > STALE_TEMPORARY_AGE)
+        fs::remove(file.path(), staleError);
+      continue;
+    }
+
+    if (file.path().extension() != EXTENSION)
+      continue;
+
+    // other processes may remove files while this one looks at them
+    std::error_code statError;
+    auto used = file.last_write_time(statError);
+    auto size = file.file_size(statError);
+    if (statError)
+      continue;
+
+    entries.push_back({file.path(), used, size});
+    total += size;
+  }
+
+  if (total <= m_maxBytes)
+    return;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+
+  for (const Entry &entry : entries) {
+    if (total <= m_maxBytes)
+      break;
+
+    fs::remove(entry.path, error);
+    total -= entry.size;
+  }
+}
+
+std::string ObjectCache::pathFor(std::uint64_t key) const {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+                static_cast<unsigned long long>(key));
+  return (fs::path(m_directory) / (name + std::string(EXTENSION))).string();
+}
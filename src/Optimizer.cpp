@@ -0,0 +1,93 @@
+#include "Optimizer.hpp"
+
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Scalar/Reassociate.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+
+std::optional<OptLevel> parseOptLevel(std::string_view flag) {
+  if (flag == "-O0")
+    return OptLevel::O0;
+  if (flag == "-O1")
+    return OptLevel::O1;
+  if (flag == "-O2")
+    return OptLevel::O2;
+  if (flag == "-O3")
+    return OptLevel::O3;
+  if (flag == "-Orepl")
+    return OptLevel::Repl;
+  return std::nullopt;
+}
+
+llvm::CodeGenOpt::Level codeGenOptLevel(OptLevel level) {
+  // the REPL tier leaves the backend at its fastest, it otherwise takes most
+  // of the time compiling a line
+  switch (level) {
+  case OptLevel::O0:
+  case OptLevel::Repl:
+    return llvm::CodeGenOpt::None;
+  case OptLevel::O1:
+    return llvm::CodeGenOpt::Less;
+  case OptLevel::O2:
+    return llvm::CodeGenOpt::Default;
+  case OptLevel::O3:
+    return llvm::CodeGenOpt::Aggressive;
+  }
+  return llvm::CodeGenOpt::Default;
+}
+
+Optimizer::Optimizer(OptLevel level, llvm::TargetMachine *machine)
+    : m_level(level), m_passBuilder(machine) {
+  m_passBuilder.registerModuleAnalyses(m_modules);
+  m_passBuilder.registerCGSCCAnalyses(m_sccs);
+  m_passBuilder.registerFunctionAnalyses(m_functions);
+  m_passBuilder.registerLoopAnalyses(m_loops);
+  m_passBuilder.crossRegisterProxies(m_loops, m_functions, m_sccs, m_modules);
+
+  switch (level) {
+  case OptLevel::O0:
+    break;
+
+  case OptLevel::O1:
+    m_pipeline = m_passBuilder.buildPerModuleDefaultPipeline(
+        llvm::OptimizationLevel::O1);
+    break;
+
+  case OptLevel::O2:
+    m_pipeline = m_passBuilder.buildPerModuleDefaultPipeline(
+        llvm::OptimizationLevel::O2);
+    break;
+
+  case OptLevel::O3:
+    m_pipeline = m_passBuilder.buildPerModuleDefaultPipeline(
+        llvm::OptimizationLevel::O3);
+    break;
+
+  case OptLevel::Repl: {
+    llvm::FunctionPassManager functions;
+    // locals live in stack slots until promoted to registers
+    functions.addPass(llvm::SROAPass());
+    functions.addPass(llvm::InstCombinePass());
+    functions.addPass(llvm::ReassociatePass());
+    functions.addPass(llvm::GVNPass());
+    functions.addPass(llvm::SimplifyCFGPass());
+    m_pipeline.addPass(
+        llvm::createModuleToFunctionPassAdaptor(std::move(functions)));
+    break;
+  }
+  }
+}
+
+void Optimizer::run(llvm::Module &module) {
+  if (m_level == OptLevel::O0)
+    return;
+
+  m_pipeline.run(module, m_modules);
+
+  // results are keyed by address, a later module may reuse this one's
+  m_loops.clear();
+  m_functions.clear();
+  m_sccs.clear();
+  m_modules.clear();
+}
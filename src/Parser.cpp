@@ -3,234 +3,375 @@
 #include "Logger.hpp"
 #include "Token.hpp"
 
+#include <llvm/ADT/SmallVector.h>
+
+#include <array>
+#include <bit>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <utility>
 #include <vector>
 
-std::unique_ptr<Stmt> Parser::parseStatement() {
+bool Parser::enableHashConsing() {
+  // heap nodes are deleted by their single owner, sharing them would free
+  // them twice
+  if (!m_arena) {
+    LogError("Hash-consing needs an arena, it is left disabled.");
+    return false;
+  }
+  m_hashCons = std::make_unique<HashConsTable>();
+  return true;
+}
+
+AstPtr<Stmt> Parser::parseStatement() {
 
-  if (match(TokenType::Def))
+  if (match(TokenType::Def)) {
+    m_blockDepth += 1;
     return parseFunctionDefinition();
-  if (match(TokenType::If))
+  }
+  if (match(TokenType::If)) {
+    m_blockDepth += 1;
     return parseIfStmt();
+  }
+  if (check(TokenType::Let)) {
+    // top level expressions are compiled one at a time, a local would not
+    // outlive its own statement
+    error("`let` is only allowed in a function body");
+    return nullptr;
+  }
 
   return parseExpressionStmt();
 }
 
-std::unique_ptr<Stmt> Parser::parseExpressionStmt() {
-  if (auto E = parseExpression()) {
-    return std::make_unique<ExpressionStmt>(std::move(E));
-  }
-  return nullptr;
+AstPtr<Stmt> Parser::parseBlockStatement() {
+  if (match(TokenType::Let))
+    return parseLetStmt();
+  if (check(TokenType::Identifier) && peekNext().m_type == TokenType::Equal)
+    return parseAssignStmt();
+
+  return parseExpressionStmt();
 }
 
-std::unique_ptr<Expr> Parser::parseExpression() {
-  auto LHS = parsePrimary();
-  if (!LHS)
+AstPtr<Stmt> Parser::parseLetStmt() {
+  if (!match(TokenType::Identifier)) {
+    error("Expected variable name after `let`");
     return nullptr;
-  return parseBinOpRHS(0, std::move(LHS));
-};
+  }
 
-std::unique_ptr<Expr> Parser::parsePrimary() {
+  Symbol name = intern(previous());
 
-  if (match(TokenType::Number))
-    return parseNumberExpr();
+  if (!match(TokenType::Equal)) {
+    error("Expected `=` after variable name");
+    return nullptr;
+  }
 
-  if (match(TokenType::Identifier))
-    return parseIdentifierExpr();
+  auto value = parseExpression();
+  if (!value)
+    return nullptr;
 
-  if (match(TokenType::LeftParen))
-    return parseGroupingExpr();
+  return make<LetStmt>(name, std::move(value));
+}
 
-  std::cout << TokenTypeToString(peek().m_type) << std::endl;
-  LogError("Unknown token when expecting an expression");
-  return nullptr;
-};
+AstPtr<Stmt> Parser::parseAssignStmt() {
+  Symbol name = intern(advance());
+  // the `=`
+  advance();
 
-std::unique_ptr<Expr> Parser::parseNumberExpr() {
+  auto value = parseExpression();
+  if (!value)
+    return nullptr;
 
-  double value = std::get<0>(previous().m_value.value());
-  return std::make_unique<NumberExpr>(value);
+  return make<AssignStmt>(name, std::move(value));
 }
 
-std::unique_ptr<Expr> Parser::parseBinOpRHS(int exprPrec,
-                                            std::unique_ptr<Expr> LHS) {
+AstPtr<Stmt> Parser::parseExpressionStmt() {
+  if (auto E = parseExpression()) {
+    return make<ExpressionStmt>(std::move(E));
+  }
+  return nullptr;
+}
 
-  while (true) {
-    int tokPrec = getTokenPrecedence();
+AstPtr<Expr> Parser::parseExpression() {
+  // the stacks are kept between calls to reuse their storage
+  auto &operands = m_operands;
+  auto &operators = m_operators;
+  auto &groups = m_groups;
+  operands.clear();
+  operators.clear();
+  groups.clear();
+
+  // folds the operators above `base` binding at least as tight as
+  // `precedence` into their operands
+  auto reduce = [&](std::size_t base, int precedence) {
+    while (operators.size() > base &&
+           binaryPrecedence(operators.back()) >= precedence) {
+      AstPtr<Expr> right = std::move(operands.back());
+      operands.pop_back();
+      AstPtr<Expr> left = std::move(operands.back());
+      operands.pop_back();
+
+      operands.push_back(
+          makeBinary(operators.back(), std::move(left), std::move(right)));
+      operators.pop_back();
+    }
+  };
 
-    if (tokPrec < exprPrec)
-      return LHS;
+  auto popOperand = [&]() {
+    AstPtr<Expr> operand = std::move(operands.back());
+    operands.pop_back();
+    return operand;
+  };
 
-    TokenType binOp = peek().m_type;
-    advance();
-    auto RHS = parsePrimary();
-    if (!RHS)
+  while (true) {
+    // an operand, opening as many groups as there are in front of it
+    if (match(TokenType::LeftParen)) {
+      groups.push_back({std::nullopt, operators.size(), {}});
+      continue;
+    }
+
+    if (match(TokenType::Number)) {
+      operands.push_back(
+          makeNumber(std::get<0>(previous().m_value.value())));
+    } else if (match(TokenType::Identifier)) {
+      Symbol name = intern(previous());
+
+      if (!match(TokenType::LeftParen)) {
+        operands.push_back(makeVariable(name));
+      } else if (match(TokenType::RightParen)) {
+        operands.push_back(makeCall(name, makeList<AstPtr<Expr>>()));
+      } else {
+        groups.push_back({name, operators.size(), makeList<AstPtr<Expr>>()});
+        continue;
+      }
+    } else {
+      error("Expected an expression");
       return nullptr;
+    }
+
+    // an operator, or the groups closed after the operand
+    while (true) {
+      std::size_t base = groups.empty() ? 0 : groups.back().operatorBase;
+      int precedence = binaryPrecedence(peek().m_type);
+
+      if (precedence >= 0) {
+        reduce(base, precedence);
+        operators.push_back(advance().m_type);
+        break;
+      }
+
+      reduce(base, 0);
+
+      if (groups.empty())
+        return popOperand();
+
+      Group &group = groups.back();
 
-    int nextPrec = getTokenPrecedence();
-    if (tokPrec < nextPrec) {
-      RHS = parseBinOpRHS(tokPrec + 1, std::move(RHS));
-      if (!RHS)
+      if (!group.callee) {
+        if (!match(TokenType::RightParen)) {
+          error("Expected `)` after expression");
+          return nullptr;
+        }
+        groups.pop_back();
+        continue;
+      }
+
+      group.args.push_back(popOperand());
+
+      if (match(TokenType::Comma))
+        break;
+
+      if (!match(TokenType::RightParen)) {
+        error("Expected `,` in argument list");
         return nullptr;
-    }
+      }
 
-    LHS = std::make_unique<BinaryExpr>(binOp, std::move(LHS), std::move(RHS));
+      operands.push_back(makeCall(*group.callee, std::move(group.args)));
+      groups.pop_back();
+    }
   }
 }
 
-std::unique_ptr<Expr> Parser::parseGroupingExpr() {
+AstPtr<Expr> Parser::makeNumber(double value) {
+  ExprKey key = {AstType::NumberExpr, TokenType::Eof,
+                 std::bit_cast<std::uint64_t>(value), {}};
+  return makeShared(key, [&]() { return make<NumberExpr>(value); });
+}
 
-  auto expr = parseExpression();
+AstPtr<Expr> Parser::makeVariable(Symbol symbol) {
+  ExprKey key = {AstType::VariableExpr, TokenType::Eof, symbol.id, {}};
+  return makeShared(key, [&]() { return make<VariableExpr>(symbol); });
+}
 
-  if (!expr)
-    return nullptr;
+AstPtr<Expr> Parser::makeBinary(TokenType operation, AstPtr<Expr> left,
+                                AstPtr<Expr> right) {
+  if (m_folder) {
+    using Kind = ConstantFolder::Fold::Kind;
+    auto fold = m_folder->fold(operation, left.get(), right.get());
 
-  if (match(TokenType::RightParen)) {
-    return std::move(expr);
-  };
+    switch (fold.kind) {
+    case Kind::Keep:
+      break;
+    case Kind::Number:
+      return makeNumber(fold.value);
+    case Kind::Left:
+      return left;
+    case Kind::Right:
+      return right;
+    case Kind::Reassociate: {
+      auto inner = left->as<BinaryExpr *>();
+      bool constantOnRight = inner->right()->type() == AstType::NumberExpr;
+      return makeBinary(operation, takeOperand(inner, constantOnRight),
+                        makeNumber(fold.value));
+    }
+    }
+  }
 
-  return nullptr;
+  std::array<const Expr *, 2> children = {left.get(), right.get()};
+  ExprKey key = {AstType::BinaryExpr, operation, 0, children};
+  return makeShared(key, [&]() {
+    return make<BinaryExpr>(operation, std::move(left), std::move(right));
+  });
+}
+
+AstPtr<Expr> Parser::takeOperand(BinaryExpr *binary, bool left) {
+  // hash-consed nodes may have other parents, arena nodes can simply be
+  // pointed to twice
+  if (m_arena)
+    return AstPtr<Expr>(left ? binary->left<Expr *>() : binary->right<Expr *>(),
+                        AstDeleter{true});
+  return left ? binary->releaseLeft() : binary->releaseRight();
 }
 
-std::unique_ptr<PrototypeStmt> Parser::parsePrototype() {
+AstPtr<Expr> Parser::makeCall(Symbol callee,
+                              std::pmr::vector<AstPtr<Expr>> args) {
+  if (!m_hashCons)
+    return make<CallExpr>(callee, std::move(args));
+
+  llvm::SmallVector<const Expr *, 8> children;
+  for (const auto &arg : args)
+    children.push_back(arg.get());
+
+  ExprKey key = {AstType::CallExpr, TokenType::Eof, callee.id, children};
+  return makeShared(
+      key, [&]() { return make<CallExpr>(callee, std::move(args)); });
+}
+
+AstPtr<PrototypeStmt> Parser::parsePrototype() {
   if (!match(TokenType::Identifier)) {
-    LogError("Expected function name in prototype.");
+    error("Expected function name in prototype");
     return nullptr;
   }
 
   assert(previous().m_value.has_value());
-  std::string_view fnName = std::get<1>(previous().m_value.value());
+  Symbol fnName = intern(previous());
 
   if (!match(TokenType::LeftParen)) {
-    LogError("Expected '(' in prototype");
+    error("Expected `(` in prototype");
     return nullptr;
   }
 
-  std::vector<std::string_view> args;
+  auto args = makeList<Symbol>();
 
   if (!match(TokenType::RightParen)) {
     while (true) {
-      if (match(TokenType::Identifier)) {
-        std::string_view arg = std::get<1>(previous().m_value.value());
-        args.push_back(std::move(arg));
-      }
+      if (match(TokenType::Identifier))
+        args.push_back(intern(previous()));
 
       if (match(TokenType::RightParen))
         break;
 
       if (!match(TokenType::Comma)) {
-        LogError("Expected ',' in prototype");
+        error("Expected `,` in prototype");
         return nullptr;
       };
     };
   }
 
-  return std::make_unique<PrototypeStmt>(fnName, std::move(args));
+  return make<PrototypeStmt>(fnName, std::move(args));
 }
 
-std::unique_ptr<Stmt> Parser::parseFunctionDefinition() {
-  std::unique_ptr<PrototypeStmt> proto = parsePrototype();
+AstPtr<Stmt> Parser::parseFunctionDefinition() {
+  AstPtr<PrototypeStmt> proto = parsePrototype();
 
   if (!proto)
     return nullptr;
 
-  std::unique_ptr<BlockStmt> body = parseBlock();
+  AstPtr<BlockStmt> body = parseBlock();
 
-  if (!body) {
-    LogError("Expected function definition");
+  if (!body)
     return nullptr;
-  }
 
-  if (!match(TokenType::End)) {
-    LogError("Expected `end` token");
+  if (!matchEnd()) {
+    error("Expected `end` after function body");
     return nullptr;
   }
 
-  return std::make_unique<FunctionStmt>(std::move(proto), std::move(body));
+  return make<FunctionStmt>(std::move(proto), std::move(body));
 }
 
-std::unique_ptr<BlockStmt> Parser::parseBlock() {
+AstPtr<BlockStmt> Parser::parseBlock() {
 
-  std::vector<std::unique_ptr<Stmt>> statements = {};
-  std::unique_ptr<ReturnStmt> returnStmt;
+  auto statements = makeList<AstPtr<Stmt>>();
+  AstPtr<ReturnStmt> returnStmt;
 
   while (!check(TokenType::Return) && !isFinished()) {
-    statements.emplace_back(parseExpressionStmt());
+    auto statement = parseBlockStatement();
+    if (!statement)
+      return nullptr;
+
+    statements.push_back(std::move(statement));
   };
 
   if (isFinished()) {
-    LogError("Unexpected end");
+    error("Unexpected end of file, expected `return`");
     return nullptr;
   }
 
   if (match(TokenType::Return)) {
     returnStmt = parseReturn();
+    if (!returnStmt)
+      return nullptr;
   }
 
-  return std::make_unique<BlockStmt>(std::move(statements),
+  return make<BlockStmt>(std::move(statements),
                                      std::move(returnStmt));
 }
 
-std::unique_ptr<ReturnStmt> Parser::parseReturn() {
+AstPtr<ReturnStmt> Parser::parseReturn() {
   auto returnValue = parseExpression();
-  auto returnStmt = std::make_unique<ReturnStmt>(std::move(returnValue));
-
-  return returnStmt;
-}
-
-std::unique_ptr<Expr> Parser::parseIdentifierExpr() {
-  std::string_view idName = std::get<1>(previous().m_value.value());
-
-  if (!match(TokenType::LeftParen)) // Simple variable ref.
-    return std::make_unique<VariableExpr>(idName);
-
-  std::vector<std::unique_ptr<Expr>> Args;
-  if (!match(TokenType::RightParen)) {
-    while (1) {
-
-      if (auto Arg = parseExpression())
-        Args.push_back(std::move(Arg));
-      else
-        return nullptr;
+  if (!returnValue)
+    return nullptr;
 
-      if (match(TokenType::RightParen))
-        break;
+  auto returnStmt = make<ReturnStmt>(std::move(returnValue));
 
-      if (!match(TokenType::Comma)) {
-        std::cout << TokenTypeToString(peek().m_type);
-        LogError("Expected ',' in argument list");
-        return nullptr;
-      };
-    }
-  }
-
-  return std::make_unique<CallExpr>(idName, std::move(Args));
+  return returnStmt;
 }
 
-std::unique_ptr<Stmt> Parser::parseIfStmt() {
-  std::unique_ptr<Expr> condition = parseExpression();
-  std::unique_ptr<Stmt> elseIf(nullptr);
-  std::unique_ptr<BlockStmt> elseBlock(nullptr);
+AstPtr<Stmt> Parser::parseIfStmt() {
+  AstPtr<Expr> condition = parseExpression();
+  AstPtr<Stmt> elseIf(nullptr);
+  AstPtr<BlockStmt> elseBlock(nullptr);
 
-  if (!condition) {
-    LogError("Expected condition");
+  if (!condition)
     return nullptr;
-  }
 
   if (!match(TokenType::Then)) {
-    LogError("Expected `then` after condition");
+    error("Expected `then` after condition");
     return nullptr;
   }
 
-  std::unique_ptr<BlockStmt> thenBlock = parseBlock();
+  AstPtr<BlockStmt> thenBlock = parseBlock();
+  if (!thenBlock)
+    return nullptr;
 
   // if condition then
   //  ...
   // end;
-  if (match(TokenType::End))
-    return std::make_unique<IfStmt>(std::move(condition), std::move(thenBlock),
+  if (matchEnd())
+    return make<IfStmt>(std::move(condition), std::move(thenBlock),
                                     nullptr, nullptr);
 
   // if condition then
@@ -241,33 +382,135 @@ std::unique_ptr<Stmt> Parser::parseIfStmt() {
   if (match(TokenType::ElseIf)) {
     // recurse
     elseIf = parseIfStmt();
+    if (!elseIf)
+      return nullptr;
     // elseIf now holds the else block so we need not to worry
-    return std::make_unique<IfStmt>(std::move(condition), std::move(thenBlock),
+    return make<IfStmt>(std::move(condition), std::move(thenBlock),
                                     std::move(elseIf), nullptr);
   }
 
   if (match(TokenType::Else)) {
     elseBlock = parseBlock();
+    if (!elseBlock)
+      return nullptr;
   }
 
-  if (!match(TokenType::End)) {
-    LogError("Expected `end` after else block");
+  if (!matchEnd()) {
+    error("Expected `end` after else block");
     return nullptr;
   }
 
-  return std::make_unique<IfStmt>(std::move(condition), std::move(thenBlock),
+  return make<IfStmt>(std::move(condition), std::move(thenBlock),
                                   std::move(elseIf), std::move(elseBlock));
 }
 
-std::vector<std::unique_ptr<Stmt>> Parser::parse() {
-  std::vector<std::unique_ptr<Stmt>> statements = {};
+std::vector<AstPtr<Stmt>> Parser::parse() {
+  std::vector<AstPtr<Stmt>> statements = {};
   while (!isFinished()) {
     auto statement = parseStatement();
     if (statement)
       statements.push_back(std::move(statement));
     else
-      break;
+      synchronize();
   }
 
   return std::move(statements);
 }
+
+std::vector<std::size_t> Parser::topLevelBoundaries(const TokenBuffer &tokens,
+                                                    std::size_t begin,
+                                                    std::size_t end,
+                                                    std::size_t minTokens) {
+  // the serial parser starts a fresh statement at these as well
+  std::vector<std::size_t> boundaries = {begin};
+  std::size_t depth = 0;
+
+  for (std::size_t i = begin; i < end; i++) {
+    switch (tokens.type(i)) {
+    case TokenType::Def:
+    case TokenType::If:
+      if (depth == 0 && i - boundaries.back() >= minTokens)
+        boundaries.push_back(i);
+      depth += 1;
+      break;
+    case TokenType::End:
+      if (depth > 0)
+        depth -= 1;
+      break;
+    default:
+      break;
+    }
+  }
+
+  boundaries.push_back(end);
+  return boundaries;
+}
+
+ParsedModule Parser::parseParallel(const TokenBuffer &tokens,
+                                   ThreadPool &pool,
+                                   std::size_t chunkTokens,
+                                   const ParseOptions &options) {
+  std::vector<std::size_t> boundaries =
+      topLevelBoundaries(tokens, 0, tokens.size(), chunkTokens);
+
+  struct ParsedChunk {
+    std::unique_ptr<AstArena> arena;
+    std::vector<AstPtr<Stmt>> statements;
+    Diagnostics diagnostics;
+  };
+
+  std::vector<std::future<ParsedChunk>> pending;
+  for (std::size_t i = 0; i + 1 < boundaries.size(); i++) {
+    std::size_t begin = boundaries[i];
+    std::size_t end = boundaries[i + 1];
+
+    pending.push_back(pool.submit([&tokens, begin, end, &options]() {
+      ParsedChunk chunk;
+      chunk.arena = std::make_unique<AstArena>();
+
+      Parser parser = Parser(tokens, begin, end, chunk.arena.get());
+      parser.setOptions(options);
+      chunk.statements = parser.parse();
+      chunk.diagnostics = parser.diagnostics();
+      return chunk;
+    }));
+  }
+
+  ParsedModule module;
+  for (auto &future : pending) {
+    ParsedChunk chunk = future.get();
+
+    module.arenas.push_back(std::move(chunk.arena));
+    module.diagnostics.append(chunk.diagnostics);
+    std::move(chunk.statements.begin(), chunk.statements.end(),
+              std::back_inserter(module.statements));
+  }
+
+  return module;
+}
+
+void Parser::synchronize() {
+  // Skip to the next top level `def`/`if`, or past the `end` that closes the
+  // block the error happened in, whichever comes first.
+  while (!isFinished()) {
+    if (check(TokenType::Def) || check(TokenType::If)) {
+      if (m_blockDepth == 0)
+        return;
+
+      m_blockDepth += 1;
+    } else if (check(TokenType::End)) {
+      advance();
+
+      if (m_blockDepth > 0)
+        m_blockDepth -= 1;
+      if (m_blockDepth == 0)
+        return;
+
+      continue;
+    }
+
+    advance();
+  }
+
+  m_blockDepth = 0;
+}
@@ -1,22 +1,151 @@
 #include <iostream>
 #include <llvm/Support/raw_ostream.h>
+#include <optional>
 #include <string>
 
+#include "AstCache.hpp"
 #include "Compiler.hpp"
 #include "Logger.hpp"
 #include "Parser.hpp"
 #include "PolyLang.hpp"
+#include "SourceManager.hpp"
+#include "ThreadPool.hpp"
+#include "TokenBuffer.hpp"
 
 void PolyLang::run() {
-  if (m_argc == 1) {
+  std::optional<std::string_view> path;
+
+  for (int i = 1; i < m_argc; i++) {
+    std::string_view argument = m_argv[i];
+
+    if (argument == "--ast-cache") {
+      m_useAstCache = true;
+    } else if (argument == "--fast-math") {
+      m_parseOptions.fastMath = true;
+    } else if (argument == "--print-ir") {
+      m_printIR = true;
+    } else if (argument == "--cache-dir" && i + 1 < m_argc) {
+      m_cacheDirectory = m_argv[++i];
+    } else if (argument == "--emit-object" && i + 1 < m_argc) {
+      m_emitPath = m_argv[++i];
+      m_emitOutput = AotCompiler::Output::Object;
+    } else if (argument == "--emit-library" && i + 1 < m_argc) {
+      m_emitPath = m_argv[++i];
+      m_emitOutput = AotCompiler::Output::SharedLibrary;
+    } else if (auto level = parseOptLevel(argument)) {
+      m_optLevel = level;
+    } else if (!path.has_value() && !argument.starts_with("--")) {
+      path = argument;
+    } else {
+      std::string message = "Unknown argument `" + std::string(argument) + "`.";
+      LogError(message.c_str());
+      m_hadError = true;
+      return;
+    }
+  }
+
+  // lines typed into the REPL are compiled one at a time, a full pipeline
+  // would dominate their latency
+  OptLevel level = m_optLevel.value_or(path ? OptLevel::O2 : OptLevel::Repl);
+  m_optLevel = level;
+
+  if (m_emitPath) {
+    if (!path) {
+      LogError("Ahead of time compilation needs a source file.");
+      m_hadError = true;
+      return;
+    }
+    runFile(path.value());
+    return;
+  }
+
+  if (m_cacheDirectory)
+    m_objectCache = std::make_unique<ObjectCache>(std::string(*m_cacheDirectory));
+  m_jit = Jit::create(level, m_objectCache.get());
+  m_compiler.setOptLevel(level, m_jit ? m_jit->targetMachine() : nullptr);
+
+  if (!path.has_value()) {
     runPrompt();
     return;
   };
-  runFile(m_argv[1]);
+  runFile(path.value());
 };
 
 void PolyLang::runFile(std::string_view path) {
-  std::cout << path << std::endl;
+  // the SourceManager keeps the mapping alive, tokens and AST names point
+  // into it
+  const SourceBuffer *file =
+      SourceManager::get().loadFile(std::string(path));
+
+  if (!file) {
+    std::string message = "Could not read file `" + std::string(path) + "`.";
+    LogError(message.c_str());
+    m_hadError = true;
+    return;
+  }
+
+  std::string cachePath = AstCache::pathFor(std::string(path));
+  std::uint64_t sourceHash = 0;
+
+  // the AOT compiler works on the linked AST, the cache is not consulted
+  if (m_useAstCache && !m_emitPath) {
+    // the folder's rewrites end up in the cache, so does its mode
+    sourceHash = AstCache::hashSource(file->contents()) ^
+                 static_cast<std::uint64_t>(m_parseOptions.fastMath);
+
+    if (std::optional<FlatAst> cached = AstCache::load(cachePath, sourceHash)) {
+      // a cache that loads is well formed, errors from here on are the
+      // source's
+      if (!lower(cached.value()))
+        m_hadError = true;
+      printModule();
+      return;
+    }
+  }
+
+  // Tokens are scanned up front so the top level definitions can be parsed in
+  // parallel.
+  Diagnostics diagnostics;
+  TokenBuffer tokens = TokenBuffer::scan(*file, &diagnostics);
+
+  ThreadPool pool;
+  ParsedModule module =
+      Parser::parseParallel(tokens, pool, 1 << 14, m_parseOptions);
+  diagnostics.append(module.diagnostics);
+
+  if (diagnostics.hasErrors()) {
+    diagnostics.print(std::cerr);
+    m_hadError = true;
+    return;
+  }
+
+  if (m_emitPath) {
+    emit(module.statements);
+    return;
+  }
+
+  bool lowered = m_jit ? lowerParallel(module.statements, pool)
+                      : lower(module.statements);
+  if (!lowered) {
+    m_hadError = true;
+    return;
+  }
+
+  // a cache that cannot be written only costs the next run a parse
+  if (m_useAstCache)
+    AstCache::write(cachePath, FlatAst::build(module.statements), sourceHash);
+
+  printModule();
+}
+
+void PolyLang::emit(const std::vector<AstPtr<Stmt>> &statements) {
+  std::string path(m_emitPath.value());
+
+  if (!AotCompiler::checkNames(statements) ||
+      !AotCompiler::compile(statements, path, m_emitOutput,
+                            m_optLevel.value()) ||
+      !AotCompiler::writeHeader(statements, path))
+    m_hadError = true;
 }
 
 void PolyLang::runPrompt() {
@@ -28,31 +157,167 @@ void PolyLang::runPrompt() {
     std::getline(std::cin, inputLine);
     if (inputLine.empty())
       break;
-    execute(inputLine);
+    const SourceBuffer *line =
+        SourceManager::get().addBuffer("<stdin>", inputLine);
+    if (!line) {
+      m_hadError = true;
+      break;
+    }
+    execute(*line);
   }
 
-  m_compiler.m_module->print(llvm::errs(), nullptr);
+  printModule();
 }
 
-void PolyLang::execute(std::string_view source) {
-  Parser parser = Parser(source);
+void PolyLang::execute(const SourceBuffer &source) {
+  // the statements are lowered right away, their nodes go away with the arena
+  AstArena arena;
+  Parser parser = Parser(source, &arena);
+  parser.setOptions(m_parseOptions);
   auto statements = parser.parse();
 
+  if (parser.hadError()) {
+    parser.diagnostics().print(std::cerr);
+    m_hadError = true;
+    return;
+  }
+
+  if (!lower(statements))
+    m_hadError = true;
+}
+
+bool PolyLang::lowerParallel(const std::vector<AstPtr<Stmt>> &statements,
+                             ThreadPool &pool) {
+  ShardOptions options = {.level = m_optLevel.value(),
+                          .keepIR = m_printIR,
+                          .cache = m_objectCache.get()};
+  auto compile = [&]() {
+    CompiledShards shards = Compiler::compileParallel(
+        statements, pool, [this]() { return m_jit->createTargetMachine(); },
+        options);
+
+    for (const std::string &ir : shards.ir)
+      llvm::errs() << ir;
+    return shards;
+  };
+
+  CompiledShards shards = compile();
+
+  if (shards.failures > 0) {
+    LogError("Compilation Error.");
+    return false;
+  }
+
+  std::size_t cached = shards.cached;
+  if (!m_jit->addObjects(std::move(shards.objects))) {
+    if (cached == 0)
+      return false;
+
+    // a cached object that does not load is compiled again, which replaces
+    // it in the cache
+    LogError("Cached objects failed to load, compiling them again.");
+    options.readCache = false;
+    shards = compile();
+    if (shards.failures > 0 || !m_jit->addObjects(std::move(shards.objects)))
+      return false;
+  }
+
+  for (const auto &statement : statements) {
+    if (statement->type() != AstType::FunctionStmt)
+      continue;
+
+    auto proto = statement->as<const FunctionStmt *>()->proto.get();
+    m_compiler.predeclare(proto->symbol, proto->argSymbols.size());
+  }
+
+  return lower(statements, /*skipDefinitions=*/true);
+}
+
+bool PolyLang::lower(const std::vector<AstPtr<Stmt>> &statements,
+                     bool skipDefinitions) {
   for (int i = 0; i < statements.size(); i++) {
-    if (!statements[i]) {
-      LogError("Parsing Error.");
-      break;
-    }
+    if (skipDefinitions && statements[i]->type() == AstType::FunctionStmt)
+      continue;
 
     auto *IR = m_compiler.codegen(statements[i].get());
 
     if (!IR) {
       LogError("Compilation Error.");
-      break;
+      return false;
+    }
+    // the module only holds this statement
+    if (m_jit)
+      m_compiler.optimize();
+    if (m_printIR)
+      IR->print(llvm::errs());
+    if (!finish(statements[i]->type() == AstType::ExpressionStmt))
+      return false;
+  }
+
+  return true;
+}
+
+bool PolyLang::lower(const FlatAst &ast) {
+  // like `lowerParallel()`, definitions go first and may be called before
+  // they appear
+  std::vector<NodeId> roots;
+  for (NodeId root : ast.roots()) {
+    if (ast.type(root) != AstType::FunctionStmt)
+      continue;
+
+    NodeId proto = ast.operands(root)[0];
+    m_compiler.predeclare(ast.symbol(proto), ast.list(proto).size());
+    roots.push_back(root);
+  }
+  for (NodeId root : ast.roots())
+    if (ast.type(root) != AstType::FunctionStmt)
+      roots.push_back(root);
+
+  for (NodeId root : roots) {
+    auto *IR = m_compiler.codegen(ast, root);
+
+    if (!IR) {
+      LogError("Compilation Error.");
+      return false;
     }
-    IR->print(llvm::errs());
+    // the module only holds this statement
+    if (m_jit)
+      m_compiler.optimize();
+    if (m_printIR)
+      IR->print(llvm::errs());
+    if (!finish(ast.type(root) == AstType::ExpressionStmt))
+      return false;
+  }
+
+  return true;
+}
+
+bool PolyLang::finish(bool isExpression) {
+  Symbol anonymous = ExpressionStmt::anonymousPrototype()->symbol;
+
+  if (!m_jit) {
+    if (isExpression)
+      m_compiler.eraseFunction(anonymous);
+    return true;
+  }
+
+  // every statement gets a module of its own, expressions are run and
+  // dropped while definitions stay for later statements to call
+  if (!isExpression)
+    return m_jit->add(m_compiler.takeModule());
+
+  auto result = m_jit->evaluate(m_compiler.takeModule(), anonymous);
+  if (!result)
+    return false;
+
+  std::cout << *result << std::endl;
+  return true;
+}
 
-    if (statements[i]->type() == AstType::ExpressionStmt)
-      static_cast<llvm::Function *>(IR)->eraseFromParent();
+void PolyLang::printModule() {
+  // with a JIT everything has been handed to it already
+  if (!m_jit) {
+    m_compiler.optimize();
+    m_compiler.m_module->print(llvm::errs(), nullptr);
   }
 }
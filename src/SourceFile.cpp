@@ -0,0 +1,100 @@
+#include "SourceFile.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+// reads everything from `fd` until EOF, used for pipes and other descriptors
+// that cannot be mapped
+static std::optional<std::string> readAll(int fd, std::size_t sizeHint) {
+  std::string buffer;
+  buffer.resize(sizeHint > 0 ? sizeHint : 64 * 1024);
+
+  std::size_t length = 0;
+  while (true) {
+    if (length == buffer.size())
+      buffer.resize(buffer.size() * 2);
+
+    ssize_t count = ::read(fd, buffer.data() + length, buffer.size() - length);
+
+    if (count == 0)
+      break;
+
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      return std::nullopt;
+    }
+
+    length += count;
+  }
+
+  buffer.resize(length);
+  return buffer;
+}
+
+std::optional<SourceFile> SourceFile::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::nullopt;
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  if (S_ISREG(info.st_mode) && info.st_size > 0) {
+    std::size_t size = info.st_size;
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data != MAP_FAILED) {
+      // the lexer walks the whole file front to back exactly once
+      ::madvise(data, size, MADV_SEQUENTIAL);
+      ::close(fd);
+      return SourceFile(static_cast<const char *>(data), size);
+    }
+  }
+
+  // not a regular file or mmap failed, fall back to reading it
+  std::size_t sizeHint = S_ISREG(info.st_mode) ? info.st_size : 0;
+  std::optional<std::string> buffer = readAll(fd, sizeHint);
+  ::close(fd);
+
+  if (!buffer.has_value())
+    return std::nullopt;
+
+  return SourceFile(std::move(buffer.value()));
+}
+
+SourceFile::SourceFile(SourceFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_isMapped(std::exchange(other.m_isMapped, false)),
+      m_buffer(std::move(other.m_buffer)) {}
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_isMapped = std::exchange(other.m_isMapped, false);
+    m_buffer = std::move(other.m_buffer);
+  }
+  return *this;
+}
+
+SourceFile::~SourceFile() { unmap(); }
+
+void SourceFile::unmap() {
+  if (m_isMapped && m_data)
+    ::munmap(const_cast<char *>(m_data), m_size);
+
+  m_data = nullptr;
+  m_size = 0;
+  m_isMapped = false;
+}
@@ -0,0 +1,128 @@
+#include "SourceManager.hpp"
+#include "CharScan.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+const std::vector<std::uint32_t> &SourceBuffer::lineStarts() const {
+  std::call_once(m_lineStartsBuilt, [this]() {
+    std::string_view text = contents();
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+
+    m_lineStarts.push_back(0);
+    for (const char *c = findNewline(begin, end); c != end;
+         c = findNewline(c + 1, end))
+      m_lineStarts.push_back(c + 1 - begin);
+  });
+
+  return m_lineStarts;
+}
+
+std::uint32_t SourceBuffer::line(SourceLoc loc) const {
+  assert(contains(loc));
+
+  const std::vector<std::uint32_t> &starts = lineStarts();
+  std::uint32_t offset = loc.offset - m_base.offset;
+
+  return std::upper_bound(starts.begin(), starts.end(), offset) -
+         starts.begin();
+}
+
+std::uint32_t SourceBuffer::column(SourceLoc loc) const {
+  std::uint32_t offset = loc.offset - m_base.offset;
+  return offset - lineStarts()[line(loc) - 1] + 1;
+}
+
+std::string_view SourceBuffer::lineText(std::uint32_t line) const {
+  const std::vector<std::uint32_t> &starts = lineStarts();
+  assert(line >= 1 && line <= starts.size());
+
+  std::string_view text = contents();
+  std::size_t start = starts[line - 1];
+  std::size_t end = line < starts.size() ? starts[line] - 1 : text.size();
+
+  return text.substr(start, end - start);
+}
+
+SourceManager &SourceManager::get() {
+  static SourceManager manager;
+  return manager;
+}
+
+const SourceBuffer *SourceManager::loadFile(const std::string &path) {
+  std::optional<SourceFile> file = SourceFile::open(path);
+  if (!file.has_value())
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::optional<SourceLoc> base = reserve(file->contents().size());
+  if (!base)
+    return nullptr;
+
+  return &insert(std::make_unique<SourceBuffer>(path, *base,
+                                                std::move(file.value())));
+}
+
+const SourceBuffer *SourceManager::addBuffer(std::string name,
+                                             std::string text) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::optional<SourceLoc> base = reserve(text.size());
+  if (!base)
+    return nullptr;
+
+  return &insert(
+      std::make_unique<SourceBuffer>(std::move(name), *base, std::move(text)));
+}
+
+const SourceBuffer *SourceManager::findBuffer(SourceLoc loc) const {
+  if (!loc.isValid())
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // buffers are sorted by base, find the last one starting at or before loc
+  auto buffer = std::upper_bound(
+      m_buffers.begin(), m_buffers.end(), loc,
+      [](SourceLoc loc, const std::unique_ptr<SourceBuffer> &buffer) {
+        return loc < buffer->base();
+      });
+
+  if (buffer == m_buffers.begin())
+    return nullptr;
+
+  buffer--;
+  return (*buffer)->contains(loc) ? buffer->get() : nullptr;
+}
+
+std::optional<ResolvedLoc> SourceManager::resolve(SourceLoc loc) const {
+  const SourceBuffer *buffer = findBuffer(loc);
+  if (!buffer)
+    return std::nullopt;
+
+  std::uint32_t line = buffer->line(loc);
+  return ResolvedLoc{buffer->name(), line, buffer->column(loc),
+                     buffer->lineText(line)};
+}
+
+const SourceBuffer &
+SourceManager::insert(std::unique_ptr<SourceBuffer> buffer) {
+  m_buffers.push_back(std::move(buffer));
+  return *m_buffers.back();
+}
+
+std::optional<SourceLoc> SourceManager::reserve(std::size_t size) {
+  // one extra slot so the `Eof` location of a buffer is not the first
+  // location of the next one, locations past the end would wrap around
+  // into earlier buffers
+  if (size >= std::numeric_limits<std::uint32_t>::max() - m_next) {
+    LogError("Too much source loaded, out of source locations.");
+    return std::nullopt;
+  }
+
+  SourceLoc base = SourceLoc(m_next);
+  m_next += size + 1;
+  return base;
+}
@@ -0,0 +1,45 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  m_workers.reserve(threads);
+  for (std::size_t i = 0; i < threads; i++)
+    m_workers.emplace_back([this]() { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+
+  m_available.notify_all();
+
+  for (std::thread &worker : m_workers)
+    worker.join();
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::function<void()> task;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_available.wait(lock,
+                       [this]() { return m_stopping || !m_tasks.empty(); });
+
+      // drain whatever is left before shutting down
+      if (m_tasks.empty())
+        return;
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+
+    task();
+  }
+}
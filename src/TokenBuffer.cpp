@@ -0,0 +1,106 @@
+#include "TokenBuffer.hpp"
+#include "Lexer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+TokenBuffer TokenBuffer::scan(std::string_view source,
+                              Diagnostics *diagnostics, SourceLoc base) {
+  assert(source.size() <= std::numeric_limits<std::uint32_t>::max());
+
+  TokenBuffer buffer = TokenBuffer(source, base);
+  Lexer lexer = Lexer(source, diagnostics, base);
+
+  while (true) {
+    Token token = lexer.nextToken();
+    buffer.push(token);
+
+    if (token.m_type == TokenType::Eof)
+      break;
+  }
+
+  return buffer;
+}
+
+TokenBuffer TokenBuffer::scan(const SourceBuffer &buffer,
+                              Diagnostics *diagnostics) {
+  return scan(buffer.contents(), diagnostics, buffer.base());
+}
+
+void TokenBuffer::push(const Token &token) {
+  if (token.m_type == TokenType::Number) {
+    m_numberTokens.push_back(m_types.size());
+    m_numbers.push_back(std::get<double>(token.m_value.value()));
+  }
+
+  m_types.push_back(token.m_type);
+  m_starts.push_back(token.m_range.begin.offset);
+  m_ends.push_back(token.m_range.end.offset);
+}
+
+Token TokenBuffer::token(std::size_t index) const {
+  if (m_types[index] != TokenType::Number)
+    return materialize(index, 0);
+
+  auto number =
+      std::lower_bound(m_numberTokens.begin(), m_numberTokens.end(), index);
+
+  return materialize(index, m_numbers[number - m_numberTokens.begin()]);
+}
+
+Token TokenBuffer::token(std::size_t index, std::size_t &cursor) const {
+  if (m_types[index] != TokenType::Number)
+    return materialize(index, 0);
+
+  if (cursor < m_numberTokens.size() && m_numberTokens[cursor] == index)
+    return materialize(index, m_numbers[cursor++]);
+
+  // the reader jumped around, find the entry and resynchronize the cursor
+  auto number =
+      std::lower_bound(m_numberTokens.begin(), m_numberTokens.end(), index);
+  cursor = number - m_numberTokens.begin() + 1;
+
+  return materialize(index, m_numbers[cursor - 1]);
+}
+
+Token TokenBuffer::materialize(std::size_t index, double number) const {
+  TokenType type = m_types[index];
+  std::uint32_t start = m_starts[index];
+  std::uint32_t end = m_ends[index];
+
+  std::optional<Object> value = std::nullopt;
+
+  switch (type) {
+  case TokenType::Number:
+    value = number;
+    break;
+  case TokenType::Identifier:
+  case TokenType::String:
+    value = m_source.substr(start - m_base.offset, end - start);
+    break;
+  default:
+    break;
+  }
+
+  return Token(type, value, SourceRange(SourceLoc(start), SourceLoc(end)));
+}
+
+std::vector<Token> TokenBuffer::unpack() const {
+  std::vector<Token> tokens;
+  tokens.reserve(size());
+
+  std::size_t cursor = 0;
+  for (std::size_t i = 0; i < size(); i++)
+    tokens.push_back(token(i, cursor));
+
+  return tokens;
+}
+
+std::size_t TokenBuffer::bytesUsed() const {
+  return m_types.capacity() * sizeof(TokenType) +
+         m_starts.capacity() * sizeof(std::uint32_t) +
+         m_ends.capacity() * sizeof(std::uint32_t) +
+         m_numberTokens.capacity() * sizeof(std::uint32_t) +
+         m_numbers.capacity() * sizeof(double);
+}
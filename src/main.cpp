@@ -5,5 +5,5 @@ int main(const int argc, const char *argv[]) {
 
   PolyLang polyLang = PolyLang(argc, argv);
   polyLang.run();
-  return 0;
+  return polyLang.hadError() ? 1 : 0;
 }
@@ -0,0 +1,474 @@
+#include "AST.hpp"
+#include "AotCompiler.hpp"
+#include "AstCache.hpp"
+#include "Compiler.hpp"
+#include "FlatAst.hpp"
+#include "Jit.hpp"
+#include "ObjectCache.hpp"
+#include "Parser.hpp"
+#include "PolyLang.hpp"
+#include "ThreadPool.hpp"
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+static std::string printModule(const llvm::Module &module) {
+  std::string text;
+  llvm::raw_string_ostream stream(text);
+  module.print(stream, nullptr);
+  return stream.str();
+}
+
+TEST(Compiler, FlatAstMatchesPointerAst) {
+  AstArena arena;
+  Parser parser = Parser("def add(x, y) return x + y * 2 end\n"
+                         "def twice(x) return add(x, x - 1) end\n"
+                         "twice(3) < add(4, 5)",
+                         &arena);
+  auto statements = parser.parse();
+  ASSERT_FALSE(parser.hadError());
+
+  Compiler pointer;
+  for (const auto &statement : statements)
+    ASSERT_NE(pointer.codegen(statement.get()), nullptr);
+
+  Compiler flat;
+  FlatAst ast = FlatAst::build(statements);
+  for (NodeId root : ast.roots())
+    ASSERT_NE(flat.codegen(ast, root), nullptr);
+
+  EXPECT_EQ(printModule(pointer.module()), printModule(flat.module()));
+}
+
+TEST(Compiler, DeeplyNestedExpressions) {
+  constexpr int depth = 100000;
+
+  std::string source = "def f(x) return ";
+  for (int i = 0; i < depth; i++)
+    source += "x * (";
+  source += "x" + std::string(depth, ')') + " end";
+
+  auto statements = Parser(source).parse();
+  ASSERT_EQ(statements.size(), 1);
+
+  Compiler pointer;
+  EXPECT_NE(pointer.codegen(statements[0].get()), nullptr);
+
+  Compiler flat;
+  FlatAst ast = FlatAst::build(statements);
+  EXPECT_NE(flat.codegen(ast, ast.roots()[0]), nullptr);
+}
+
+TEST(Compiler, SharedSubexpressionsEmittedOnce) {
+  AstArena arena;
+  Parser parser = Parser("def f(x, y) return x * y + (x * y) * (x * y) end\n"
+                         "def g(x, y) return x * y end",
+                         &arena);
+  parser.enableHashConsing();
+  auto statements = parser.parse();
+  ASSERT_FALSE(parser.hadError());
+
+  Compiler compiler;
+  for (const auto &statement : statements)
+    ASSERT_NE(compiler.codegen(statement.get()), nullptr);
+
+  // once in `f`, and again in `g` where the value of `f` is out of reach
+  std::string text = printModule(compiler.module());
+  std::size_t multiplications = 0;
+  for (std::size_t at = text.find("fmul"); at != std::string::npos;
+       at = text.find("fmul", at + 1))
+    multiplications += 1;
+  EXPECT_EQ(multiplications, 3);
+}
+
+TEST(Compiler, FoldedConstants) {
+  Parser parser = Parser("def f(x) return (x == x) * (2 * 3 == 6) end");
+  parser.enableConstantFolding();
+  auto statements = parser.parse();
+  ASSERT_EQ(statements.size(), 1);
+
+  Compiler compiler;
+  ASSERT_NE(compiler.codegen(statements[0].get()), nullptr);
+
+  // the right side folded to 1, which the multiplication then drops
+  std::string text = printModule(compiler.module());
+  EXPECT_NE(text.find("fcmp oeq double %x, %x"), std::string::npos);
+  EXPECT_EQ(text.find("fmul"), std::string::npos);
+}
+
+TEST(Compiler, LocalsPromotedToRegisters) {
+  std::string source = "def f(x, y)\n"
+                       "  let d = x - y\n"
+                       "  let s = d * d\n"
+                       "  s = s + s\n"
+                       "  return s / d\n"
+                       "end";
+  auto statements = Parser(source).parse();
+  ASSERT_EQ(statements.size(), 1);
+
+  Compiler compiler;
+  ASSERT_NE(compiler.codegen(statements[0].get()), nullptr);
+  std::string text = printModule(compiler.module());
+  EXPECT_NE(text.find("alloca"), std::string::npos);
+
+  // the flat AST lowers locals the same way
+  Compiler flat;
+  FlatAst ast = FlatAst::build(statements);
+  ASSERT_NE(flat.codegen(ast, ast.roots()[0]), nullptr);
+  EXPECT_EQ(printModule(flat.module()), text);
+
+  // even the cheapest tier keeps them in registers
+  compiler.setOptLevel(OptLevel::Repl);
+  compiler.optimize();
+  text = printModule(compiler.module());
+  EXPECT_EQ(text.find("alloca"), std::string::npos);
+  EXPECT_EQ(text.find("load"), std::string::npos);
+}
+
+TEST(Compiler, UnknownAssignmentFails) {
+  auto statements = Parser("def f(x) y = x return y end").parse();
+  ASSERT_EQ(statements.size(), 1);
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.codegen(statements[0].get()), nullptr);
+  EXPECT_EQ(compiler.module().getFunction("f"), nullptr);
+}
+
+TEST(Jit, AssignedLocals) {
+  auto jit = Jit::create();
+  ASSERT_NE(jit, nullptr);
+
+  AstArena arena;
+  Parser parser = Parser("def h(x)\n"
+                         "  let a = x * 2\n"
+                         "  x = 10\n"
+                         // shares `x * 2` with the first line, whose value
+                         // is stale by now
+                         "  let a = a + x * 2\n"
+                         "  return a\n"
+                         "end\n"
+                         "h(1)",
+                         &arena);
+  parser.enableHashConsing();
+  auto statements = parser.parse();
+  ASSERT_EQ(statements.size(), 2);
+
+  Compiler compiler;
+  ASSERT_NE(compiler.codegen(statements[0].get()), nullptr);
+  ASSERT_TRUE(jit->add(compiler.takeModule()));
+  ASSERT_NE(compiler.codegen(statements[1].get()), nullptr);
+  EXPECT_EQ(jit->evaluate(compiler.takeModule(),
+                          ExpressionStmt::anonymousPrototype()->symbol),
+            22);
+}
+
+TEST(Jit, DefinitionsAcrossLines) {
+  auto jit = Jit::create();
+  ASSERT_NE(jit, nullptr);
+
+  Compiler compiler;
+  Symbol anonymous = ExpressionStmt::anonymousPrototype()->symbol;
+
+  // one module per line, like the REPL
+  auto compile = [&](std::string_view line) {
+    auto statements = Parser(line).parse();
+    EXPECT_EQ(statements.size(), 1);
+    EXPECT_NE(compiler.codegen(statements[0].get()), nullptr);
+    return compiler.takeModule();
+  };
+
+  EXPECT_TRUE(jit->add(compile("def add(x, y) return x + y end")));
+  EXPECT_EQ(jit->evaluate(compile("add(1, 2)"), anonymous), 3);
+
+  EXPECT_TRUE(jit->add(compile("def twice(x) return add(x, x) end")));
+  EXPECT_EQ(jit->evaluate(compile("twice(add(1, 2)) * 2"), anonymous), 12);
+  EXPECT_EQ(jit->evaluate(compile("(twice(4) < 9) + (1 == 1)"), anonymous), 2);
+
+  // the first definition stays
+  EXPECT_FALSE(jit->add(compile("def add(x, y) return x - y end")));
+}
+
+TEST(Jit, ParallelShards) {
+  auto jit = Jit::create();
+  ASSERT_NE(jit, nullptr);
+
+  // every function calls the one before it, across shard boundaries
+  std::string source = "def f0(x) return x + 1 end\n";
+  for (int i = 1; i < 50; i++)
+    source += "def f" + std::to_string(i) + "(x) return f" +
+              std::to_string(i - 1) + "(x) + 1 end\n";
+  source += "f49(0)\n";
+
+  AstArena arena;
+  auto statements = Parser(source, &arena).parse();
+  ASSERT_EQ(statements.size(), 51);
+
+  ThreadPool pool(4);
+  CompiledShards shards = Compiler::compileParallel(
+      statements, pool, [&]() { return jit->createTargetMachine(); },
+      {.level = OptLevel::O1, .shards = 8});
+  EXPECT_EQ(shards.failures, 0);
+  ASSERT_EQ(shards.objects.size(), 8);
+
+  for (auto &object : shards.objects)
+    ASSERT_TRUE(jit->addObject(std::move(object)));
+
+  Compiler compiler;
+  compiler.predeclare(Interner::get().intern("f49"), 1);
+  ASSERT_NE(compiler.codegen(statements.back().get()), nullptr);
+  EXPECT_EQ(jit->evaluate(compiler.takeModule(),
+                          ExpressionStmt::anonymousPrototype()->symbol),
+            50);
+}
+
+// `source` compiled to an object for the host
+static std::unique_ptr<llvm::MemoryBuffer>
+compileObject(std::string_view source) {
+  auto jit = Jit::create();
+  if (!jit)
+    return nullptr;
+
+  auto statements = Parser(source).parse();
+  Compiler compiler;
+  compiler.setOptLevel(OptLevel::O0, jit->targetMachine());
+  for (const auto &statement : statements)
+    if (!compiler.codegen(statement.get()))
+      return nullptr;
+  return compiler.emitObject();
+}
+
+TEST(ObjectCache, EvictsLeastRecentlyUsed) {
+  namespace fs = std::filesystem;
+  fs::path directory = fs::temp_directory_path() /
+                       ("polylang-object-cache-" + std::to_string(::getpid()));
+  fs::remove_all(directory);
+
+  auto compiled = compileObject("def g(x) return x end");
+  ASSERT_NE(compiled, nullptr);
+  llvm::MemoryBufferRef buffer = *compiled;
+  std::string object = buffer.getBuffer().str();
+
+  // room for two objects
+  ObjectCache cache(directory.string(), object.size() * 5 / 2);
+
+  ASSERT_TRUE(cache.store(1, buffer));
+  ASSERT_TRUE(cache.store(2, buffer));
+  EXPECT_EQ(cache.lookup(3), nullptr);
+
+  // age the objects, then use the first one again
+  for (const auto &file : fs::directory_iterator(directory))
+    fs::last_write_time(file.path(), fs::file_time_type::clock::now() -
+                                         std::chrono::hours(1));
+  auto first = cache.lookup(1);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first->getBuffer(), object);
+
+  // over budget, the second one has not been used the longest
+  ASSERT_TRUE(cache.store(3, buffer));
+  EXPECT_NE(cache.lookup(1), nullptr);
+  EXPECT_EQ(cache.lookup(2), nullptr);
+  EXPECT_NE(cache.lookup(3), nullptr);
+
+  fs::remove_all(directory);
+}
+
+TEST(ObjectCache, DropsDamagedFiles) {
+  namespace fs = std::filesystem;
+  fs::path directory = fs::temp_directory_path() /
+                       ("polylang-damaged-cache-" + std::to_string(::getpid()));
+  fs::remove_all(directory);
+
+  auto compiled = compileObject("def g(x) return x end");
+  ASSERT_NE(compiled, nullptr);
+
+  ObjectCache cache(directory.string());
+  ASSERT_TRUE(cache.store(1, *compiled));
+  ASSERT_NE(cache.lookup(1), nullptr);
+
+  // e.g. a writer that crashed halfway on a file system without atomic
+  // renames
+  fs::path stored = fs::directory_iterator(directory)->path();
+  fs::resize_file(stored, 20);
+  EXPECT_EQ(cache.lookup(1), nullptr);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_FALSE(fs::exists(stored));
+
+  // temporary files are only removed once their writer is surely gone
+  fs::path stale = directory / "0000000000000002.o.tmp.1.2";
+  fs::path live = directory / "0000000000000003.o.tmp.1.2";
+  std::ofstream(stale) << "partial";
+  std::ofstream(live) << "partial";
+  fs::last_write_time(stale, fs::file_time_type::clock::now() -
+                                 std::chrono::hours(1));
+  cache.evict();
+  EXPECT_FALSE(fs::exists(stale));
+  EXPECT_TRUE(fs::exists(live));
+
+  fs::remove_all(directory);
+}
+
+TEST(Jit, AddsObjectsAtomically) {
+  auto jit = Jit::create();
+  ASSERT_NE(jit, nullptr);
+
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects;
+  objects.push_back(compileObject("def atomicA(x) return x end"));
+  // defines `atomicA` again
+  objects.push_back(compileObject("def atomicA(x) return x + 1 end"));
+  EXPECT_FALSE(jit->addObjects(std::move(objects)));
+
+  // nothing of the first attempt stayed behind
+  objects.clear();
+  objects.push_back(compileObject("def atomicA(x) return x * 2 end"));
+  ASSERT_TRUE(jit->addObjects(std::move(objects)));
+  auto atomicA = reinterpret_cast<double (*)(double)>(
+      jit->lookup(Interner::get().intern("atomicA")));
+  ASSERT_NE(atomicA, nullptr);
+  EXPECT_EQ(atomicA(4), 8);
+}
+
+TEST(ObjectCache, SkipsCompilingShards) {
+  namespace fs = std::filesystem;
+  fs::path directory = fs::temp_directory_path() /
+                       ("polylang-shard-cache-" + std::to_string(::getpid()));
+  fs::remove_all(directory);
+
+  std::string source;
+  for (int i = 0; i < 8; i++)
+    source += "def g" + std::to_string(i) + "(x) return x * " +
+              std::to_string(i) + " end\n";
+
+  AstArena arena;
+  auto statements = Parser(source, &arena).parse();
+
+  ObjectCache cache(directory.string());
+  ThreadPool pool(2);
+  ShardOptions options = {.shards = 4, .cache = &cache};
+
+  auto compile = [&]() {
+    auto jit = Jit::create();
+    CompiledShards shards = Compiler::compileParallel(
+        statements, pool, [&]() { return jit->createTargetMachine(); },
+        options);
+    EXPECT_EQ(shards.objects.size(), 4);
+    for (auto &object : shards.objects)
+      EXPECT_TRUE(jit->addObject(std::move(object)));
+
+    auto g7 = reinterpret_cast<double (*)(double)>(
+        jit->lookup(Interner::get().intern("g7")));
+    EXPECT_EQ(g7(3), 21);
+  };
+
+  compile();
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_EQ(cache.misses(), 4);
+
+  // e.g. the next start of the process
+  compile();
+  EXPECT_EQ(cache.hits(), 4);
+
+  fs::remove_all(directory);
+}
+
+TEST(Aot, EmitsLibraryAndHeader) {
+  namespace fs = std::filesystem;
+  fs::path directory =
+      fs::temp_directory_path() / ("polylang-aot-" + std::to_string(::getpid()));
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  AstArena arena;
+  // `aotHypot2` calls `aotSquare` before its definition
+  auto statements = Parser("def aotHypot2(a, b)\n"
+                           "  return aotSquare(a) + aotSquare(b)\n"
+                           "end\n"
+                           "def aotSquare(x) return x * x end\n"
+                           "aotSquare(2)",
+                           &arena)
+                        .parse();
+
+  std::string object = (directory / "kernels.o").string();
+  ASSERT_TRUE(AotCompiler::compile(statements, object,
+                                   AotCompiler::Output::Object, OptLevel::O2));
+  std::ifstream objectFile(object, std::ios::binary);
+  char magic[4] = {};
+  objectFile.read(magic, 4);
+  EXPECT_EQ(std::string(magic, 4), "\x7f" "ELF");
+
+  std::string library = (directory / "kernels.so").string();
+  ASSERT_TRUE(AotCompiler::compile(statements, library,
+                                   AotCompiler::Output::SharedLibrary,
+                                   OptLevel::O2));
+  ASSERT_TRUE(AotCompiler::writeHeader(statements, library));
+
+  std::string error;
+  auto handle =
+      llvm::sys::DynamicLibrary::getPermanentLibrary(library.c_str(), &error);
+  ASSERT_TRUE(handle.isValid()) << error;
+  auto hypot2 = reinterpret_cast<double (*)(double, double)>(
+      handle.getAddressOfSymbol("aotHypot2"));
+  ASSERT_NE(hypot2, nullptr);
+  EXPECT_EQ(hypot2(3, 4), 25);
+
+  std::ifstream headerFile(AotCompiler::headerPathFor(library));
+  std::stringstream header;
+  header << headerFile.rdbuf();
+  EXPECT_NE(header.str().find("#ifndef KERNELS_H"), std::string::npos);
+  EXPECT_NE(header.str().find("double aotSquare(double);"),
+            std::string::npos);
+  EXPECT_NE(header.str().find("double aotHypot2(double, double);"),
+            std::string::npos);
+  // the top level expression has no symbol to declare
+  EXPECT_EQ(header.str().find("__anon"), std::string::npos);
+
+  fs::remove_all(directory);
+}
+
+TEST(Aot, ChecksNamesForC) {
+  // argument names never reach the header
+  auto statements = Parser("def scale(int, double) return int * double end")
+                        .parse();
+  ASSERT_EQ(statements.size(), 1);
+  EXPECT_TRUE(AotCompiler::checkNames(statements));
+  EXPECT_NE(AotCompiler::header(statements, "SCALE_H")
+                .find("double scale(double, double);"),
+            std::string::npos);
+
+  for (const char *source : {"def int(x) return x end",
+                             "def _Kernel(x) return x end",
+                             "def __kernel(x) return x end"})
+    EXPECT_FALSE(AotCompiler::checkNames(Parser(source).parse())) << source;
+}
+
+TEST(PolyLang, CachedForwardReference) {
+  namespace fs = std::filesystem;
+  fs::path source = fs::temp_directory_path() /
+                    ("polylang-forward-" + std::to_string(::getpid()) + ".pl");
+  std::ofstream(source) << "g(2)\ndef g(x) return x * 3 end\n";
+  std::string path = source.string();
+  std::string cachePath = AstCache::pathFor(path);
+
+  // parsed and cached, then lowered from the cache
+  for (int run = 0; run < 2; run++) {
+    const char *argv[] = {"PolyLang", "--ast-cache", path.c_str()};
+    PolyLang polyLang(3, argv);
+
+    testing::internal::CaptureStdout();
+    polyLang.run();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "6\n") << run;
+    EXPECT_FALSE(polyLang.hadError()) << run;
+    EXPECT_TRUE(fs::exists(cachePath)) << run;
+  }
+
+  fs::remove(source);
+  fs::remove(cachePath);
+}
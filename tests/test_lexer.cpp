@@ -3,6 +3,9 @@
 #include <iterator>
 #include <gtest/gtest.h>
 #include <Lexer.hpp>
+#include <SourceManager.hpp>
+#include <ThreadPool.hpp>
+#include <TokenBuffer.hpp>
 
 TEST(Lexer, SingleCharTokens) {
   Lexer lexer = Lexer("+ = / * > < ! () ,");
@@ -133,3 +136,198 @@ TEST(Lexer, Number) {
   ASSERT_EQ(tokens.back().m_type, TokenType::Eof);
 
 }
+
+TEST(Lexer, PackedTokenBuffer) {
+  std::string_view source = "def f(x) return x * 2.5 end\n f(\"str\") // done";
+  auto tokens = Lexer(source).scanTokens();
+  auto packed = TokenBuffer::scan(source);
+
+  ASSERT_EQ(packed.size(), tokens.size());
+
+  for (unsigned int i=0; i < tokens.size(); i++) {
+    Token token = packed.token(i);
+    EXPECT_EQ(token.m_type, tokens[i].m_type) << i;
+    EXPECT_EQ(token.m_value, tokens[i].m_value) << i;
+    EXPECT_EQ(token.m_range, tokens[i].m_range) << i;
+  }
+}
+
+TEST(Lexer, PackedTokenBufferRandomAccess) {
+  auto packed = TokenBuffer::scan("1 + 20 * f(300, x, 4000.5) - 50000");
+
+  // the cursor starts out of sync, in the middle of the buffer and when read
+  // backwards
+  std::vector<std::size_t> order;
+  for (std::size_t i = packed.size() / 2; i < packed.size(); i++)
+    order.push_back(i);
+  for (std::size_t i = packed.size(); i-- > 0;)
+    order.push_back(i);
+
+  std::size_t cursor = 0;
+  for (std::size_t i : order) {
+    Token token = packed.token(i, cursor);
+    Token expected = packed.token(i);
+    EXPECT_EQ(token.m_type, expected.m_type) << i;
+    EXPECT_EQ(token.m_value, expected.m_value) << i;
+    EXPECT_EQ(token.m_range, expected.m_range) << i;
+  }
+}
+
+TEST(Lexer, LongRuns) {
+  std::string indent(70, ' ');
+  std::string name = "a_very_long_generated_identifier_name_that_spans_vectors_0123";
+  std::string digits = "123456789012345678901234567890123";
+  std::string source = indent + name + "\n\n\t\r\n" + indent + digits + ".25" +
+                       "  // " + std::string(80, 'x') + "\n" + name + "é";
+
+  auto &buffer = *SourceManager::get().addBuffer("long_runs", source);
+  Lexer lexer = Lexer(buffer);
+  auto tokens = lexer.scanTokens();
+
+  ASSERT_EQ(tokens.size(), 4);
+  EXPECT_EQ(tokens[0].m_type, TokenType::Identifier);
+  EXPECT_EQ(tokens[0].m_value.value(), Object(name));
+  EXPECT_EQ(buffer.line(tokens[0].m_range.begin), 1);
+  EXPECT_EQ(buffer.column(tokens[0].m_range.begin), 71);
+
+  EXPECT_EQ(tokens[1].m_type, TokenType::Number);
+  EXPECT_EQ(tokens[1].m_value.value(), Object(123456789012345678901234567890123.25));
+  EXPECT_EQ(buffer.line(tokens[1].m_range.begin), 4);
+
+  EXPECT_EQ(tokens[2].m_type, TokenType::Identifier);
+  EXPECT_EQ(tokens[2].m_value.value(), Object(name));
+  EXPECT_EQ(buffer.line(tokens[2].m_range.begin), 5);
+  EXPECT_EQ(buffer.lineText(5), name + "é");
+
+  EXPECT_EQ(tokens[3].m_type, TokenType::Eof);
+}
+
+TEST(Lexer, KeywordLookalikes) {
+  Lexer lexer = Lexer("elf iff ends returns extern_ Def o r");
+  auto tokens = lexer.scanTokens();
+
+  ASSERT_EQ(tokens.size(), 9);
+
+  for (unsigned int i=0; i < tokens.size() - 1; i++) {
+    EXPECT_EQ(tokens[i].m_type, TokenType::Identifier) << i;
+  }
+}
+
+TEST(Lexer, ReportsErrorsWithoutStopping) {
+  Lexer lexer = Lexer("1 $ 2 @ 3 \"unterminated");
+  auto tokens = lexer.scanTokens();
+
+  ASSERT_EQ(tokens.size(), 4);
+  EXPECT_EQ(tokens[2].m_type, TokenType::Number);
+  EXPECT_EQ(tokens[3].m_type, TokenType::Eof);
+
+  ASSERT_EQ(lexer.diagnostics().count(), 3);
+  EXPECT_EQ(lexer.diagnostics().errors()[0].m_message, "Unexpected character");
+  EXPECT_EQ(lexer.diagnostics().errors()[2].m_message, "Unterminated string");
+}
+
+TEST(Lexer, SourceManagerLocations) {
+  auto &first = *SourceManager::get().addBuffer("first", "a\nb");
+  auto &second = *SourceManager::get().addBuffer("second", "\n\n  c");
+
+  auto tokens = Lexer(second).scanTokens();
+  ASSERT_EQ(tokens.size(), 2);
+
+  auto loc = SourceManager::get().resolve(tokens[0].m_range.begin);
+  ASSERT_TRUE(loc.has_value());
+  EXPECT_EQ(loc->bufferName, "second");
+  EXPECT_EQ(loc->line, 3);
+  EXPECT_EQ(loc->column, 3);
+  EXPECT_EQ(loc->lineText, "  c");
+
+  // the `Eof` of one buffer must not resolve into the next one
+  auto eof = Lexer(first).scanTokens().back();
+  EXPECT_EQ(SourceManager::get().findBuffer(eof.m_range.begin), &first);
+}
+
+TEST(Lexer, ParallelMatchesSerial) {
+  // strings spanning chunk boundaries, quotes inside comments and a string
+  // left open at the very end
+  std::string source;
+  for (int i = 0; i < 200; i++) {
+    source += "def f" + std::to_string(i) + "(x) return x * 1." +
+              std::to_string(i) + " end\n";
+    source += "// a \" quote in a comment\n";
+    if (i % 7 == 0)
+      source += "\"a string\nspanning\nlines\" $\n";
+    if (i % 13 == 0)
+      source += "\n\n      \n";
+  }
+  source += "\"left open\n";
+
+  auto &buffer = *SourceManager::get().addBuffer("parallel", source);
+
+  Diagnostics serialErrors;
+  auto serial = Lexer(buffer, &serialErrors).scanTokens();
+
+  ThreadPool pool(4);
+  for (std::size_t chunkSize : {1, 7, 64, 1000, 1 << 20}) {
+    Diagnostics parallelErrors;
+    auto parallel =
+        Lexer::scanTokensParallel(buffer, pool, &parallelErrors, chunkSize);
+
+    ASSERT_EQ(parallel.size(), serial.size()) << chunkSize;
+    for (unsigned int i=0; i < serial.size(); i++) {
+      ASSERT_EQ(parallel[i].m_type, serial[i].m_type) << i;
+      ASSERT_EQ(parallel[i].m_value, serial[i].m_value) << i;
+      ASSERT_EQ(parallel[i].m_range, serial[i].m_range) << i;
+    }
+
+    ASSERT_EQ(parallelErrors.count(), serialErrors.count());
+    for (unsigned int i=0; i < serialErrors.count(); i++) {
+      EXPECT_EQ(parallelErrors.errors()[i].m_message,
+                serialErrors.errors()[i].m_message);
+      EXPECT_EQ(parallelErrors.errors()[i].m_range,
+                serialErrors.errors()[i].m_range);
+    }
+  }
+}
+
+TEST(Lexer, IncrementalRelex) {
+  std::string before = "def area(w, h) return w * h end\n"
+                       "// comment \" with a quote\n"
+                       "area(1.5, 2) \"text\" other_name 12";
+
+  struct Case {
+    std::size_t offset;
+    std::size_t removed;
+    std::string inserted;
+  };
+
+  std::vector<Case> cases = {
+      {4, 4, "volume"},      // rename a function
+      {25, 0, "+ 1 "},       // insert tokens
+      {33, 2, ""},           // turn the comment into code
+      {0, 0, "\""},          // open a string that swallows everything
+      {70, 0, "5"},          // extend a number
+      {62, 1, ""},           // `1.5` becomes `15`
+      {before.size(), 0, " tail"},
+      {0, before.size(), "x"},
+  };
+
+  for (const Case &edit : cases) {
+    std::string after = before;
+    after.replace(edit.offset, edit.removed, edit.inserted);
+
+    auto &previous = *SourceManager::get().addBuffer("before", before);
+    auto &current = *SourceManager::get().addBuffer("after", after);
+
+    auto tokens = Lexer(previous).scanTokens();
+    Lexer::relex(tokens, previous, current,
+                 TextEdit{edit.offset, edit.removed, edit.inserted});
+
+    auto expected = Lexer(current).scanTokens();
+
+    ASSERT_EQ(tokens.size(), expected.size()) << edit.offset;
+    for (unsigned int i=0; i < expected.size(); i++) {
+      EXPECT_EQ(tokens[i].m_type, expected[i].m_type) << edit.offset << ' ' << i;
+      EXPECT_EQ(tokens[i].m_value, expected[i].m_value) << edit.offset << ' ' << i;
+      EXPECT_EQ(tokens[i].m_range, expected[i].m_range) << edit.offset << ' ' << i;
+    }
+  }
+}
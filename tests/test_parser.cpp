@@ -1,9 +1,16 @@
 #include "AST.hpp"
+#include "AstCache.hpp"
+#include "FlatAst.hpp"
+#include "IncrementalParser.hpp"
 #include "Lexer.hpp"
 #include "Parser.hpp"
+#include "ThreadPool.hpp"
 #include "Token.hpp"
+#include "TokenBuffer.hpp"
 
 #include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
 #include <memory>
 
 TEST(Parser, NumberExpr) {
@@ -148,6 +155,32 @@ TEST(Parser, FunctionDefinition) {
   EXPECT_EQ(returnValue->right<VariableExpr *>()->name, "y");
 }
 
+TEST(Parser, LetAndAssignment) {
+  Parser parser = Parser("def f(x) let y = x * 2 x = y + 1 return x end\n"
+                         "let z = 1");
+  auto statements = parser.parse();
+
+  // locals only exist inside function bodies
+  EXPECT_TRUE(parser.hadError());
+  ASSERT_EQ(statements.size(), 1);
+
+  auto body = statements[0]->as<FunctionStmt *>()->body.get();
+  ASSERT_EQ(body->statements.size(), 2);
+
+  ASSERT_EQ(body->statements[0]->type(), AstType::LetStmt);
+  auto let = body->statements[0]->as<LetStmt *>();
+  EXPECT_EQ(let->name, "y");
+  EXPECT_EQ(let->value->as<BinaryExpr *>()->operation, TokenType::Star);
+
+  ASSERT_EQ(body->statements[1]->type(), AstType::AssignStmt);
+  auto assign = body->statements[1]->as<AssignStmt *>();
+  EXPECT_EQ(assign->name, "x");
+  EXPECT_EQ(assign->value->as<BinaryExpr *>()->left<VariableExpr *>()->name,
+            "y");
+
+  EXPECT_EQ(body->returnStmt->returnValue->as<VariableExpr *>()->name, "x");
+}
+
 TEST(Parser, SimpleIf) {
   Parser parser = Parser("if 10 == 2*10 then return 0 end");
   auto statements = parser.parse();
@@ -178,3 +211,408 @@ TEST(Parser, SimpleIf) {
 
   EXPECT_EQ(returnValue->value, 0);
 }
+
+TEST(Parser, PreLexedTokens) {
+  Lexer lexer = Lexer("def add(x,y) return x + y end add(1, 2)");
+  Parser parser = Parser(lexer.scanTokens());
+  auto statements = parser.parse();
+
+  ASSERT_EQ(statements.size(), 2);
+  EXPECT_EQ(statements[0]->type(), AstType::FunctionStmt);
+  EXPECT_EQ(statements[1]->type(), AstType::ExpressionStmt);
+
+  auto call = statements[1]->as<ExpressionStmt *>()->body->as<CallExpr *>();
+  EXPECT_EQ(call->callee, "add");
+  EXPECT_EQ(call->args.size(), 2);
+}
+
+TEST(Parser, RecoversFromErrors) {
+  Parser parser = Parser("def f(x) return x + end\n"
+                         "def g(y) return (y end\n"
+                         "def h(z) return z end\n"
+                         "h(1)");
+  auto statements = parser.parse();
+
+  EXPECT_EQ(parser.diagnostics().count(), 2);
+
+  ASSERT_EQ(statements.size(), 2);
+  EXPECT_EQ(statements[0]->type(), AstType::FunctionStmt);
+  EXPECT_EQ(statements[0]->as<FunctionStmt *>()->proto->name, "h");
+  EXPECT_EQ(statements[1]->type(), AstType::ExpressionStmt);
+}
+
+TEST(Parser, InternedNames) {
+  std::vector<AstPtr<Stmt>> first, second;
+  {
+    // names must outlive the text they were parsed from
+    std::string line = "def scale(value) return value * 2 end";
+    first = Parser(line).parse();
+    line = "scale(value)";
+    second = Parser(line).parse();
+  }
+
+  auto proto = first[0]->as<FunctionStmt *>()->proto.get();
+  auto call = second[0]->as<ExpressionStmt *>()->body->as<CallExpr *>();
+  auto arg = call->args[0]->as<VariableExpr *>();
+
+  EXPECT_EQ(proto->symbol, call->calleeSymbol);
+  EXPECT_EQ(proto->argSymbols[0], arg->symbol);
+  EXPECT_EQ(call->callee, "scale");
+  EXPECT_EQ(arg->name, "value");
+  EXPECT_EQ(Interner::get().name(arg->symbol), "value");
+}
+
+TEST(Parser, ArenaAllocatedNodes) {
+  AstArena arena;
+  Parser parser = Parser("def add(x, y) return x + y end\n"
+                         "if add(1, 2) then return 3 end\n"
+                         "add(4, 5)",
+                         &arena);
+  auto statements = parser.parse();
+
+  ASSERT_EQ(statements.size(), 3);
+  EXPECT_EQ(statements[0]->type(), AstType::FunctionStmt);
+  EXPECT_EQ(statements[1]->type(), AstType::IfStmt);
+  EXPECT_EQ(statements[2]->type(), AstType::ExpressionStmt);
+
+  auto proto = statements[0]->as<FunctionStmt *>()->proto.get();
+  EXPECT_EQ(proto->args.size(), 2);
+  EXPECT_EQ(proto->args[1], "y");
+
+  // anonymous expressions share one prototype instead of allocating it
+  auto call = statements[2]->as<ExpressionStmt *>();
+  EXPECT_EQ(call->proto.get(), ExpressionStmt::anonymousPrototype());
+  EXPECT_EQ(call->body->as<CallExpr *>()->args.size(), 2);
+
+  // function, prototype, block, return, binary, 2 variables
+  // if, call, 2 numbers, block, return, number
+  // expression, call, 2 numbers
+  EXPECT_EQ(arena.nodeCount(), 18);
+  EXPECT_GT(arena.bytesUsed(), 0);
+  EXPECT_LE(arena.bytesUsed(), arena.bytesReserved());
+}
+
+TEST(Parser, HashConsing) {
+  AstArena arena;
+  Parser parser = Parser("def f(x, y) return x * y + (x * y) * 2 end\n"
+                         "f(1, 2) - f(1, 2)",
+                         &arena);
+  parser.enableHashConsing();
+  auto statements = parser.parse();
+  ASSERT_EQ(statements.size(), 2);
+
+  auto function = statements[0]->as<FunctionStmt *>();
+  auto sum = function->body->returnStmt->returnValue->as<BinaryExpr *>();
+  EXPECT_EQ(sum->left(), sum->right()->as<const BinaryExpr *>()->left());
+
+  auto expression = statements[1]->as<ExpressionStmt *>();
+  auto difference = expression->body->as<BinaryExpr *>();
+  EXPECT_EQ(difference->left(), difference->right());
+  // the `2` is shared across statements too
+  EXPECT_EQ(difference->left()->as<const CallExpr *>()->args[1].get(),
+            sum->right()->as<const BinaryExpr *>()->right());
+
+  // function, prototype, block, return, x, y, x * y, 2, (x * y) * 2, sum
+  // expression, 1, call, difference
+  EXPECT_EQ(arena.nodeCount(), 14);
+  EXPECT_EQ(parser.hashConsTable()->hits(), 7);
+}
+
+// parses one expression statement into `kept`, returns its body
+static const Expr *parseBody(Parser &parser,
+                             std::vector<AstPtr<Stmt>> &kept) {
+  auto statements = parser.parse();
+  EXPECT_EQ(statements.size(), 1);
+  kept.push_back(std::move(statements[0]));
+  return kept.back()->as<ExpressionStmt *>()->body.get();
+}
+
+static double numberOf(const Expr *expr) {
+  EXPECT_EQ(expr->type(), AstType::NumberExpr);
+  return expr->as<const NumberExpr *>()->value;
+}
+
+TEST(Parser, HashConsingNeedsArena) {
+  // heap nodes have a single owner, sharing them would free them twice
+  Parser parser = Parser("x * y + (\nx * y + 1\n");
+  EXPECT_FALSE(parser.enableHashConsing());
+  EXPECT_EQ(parser.hashConsTable(), nullptr);
+
+  // the broken statement is dropped, none of its nodes is freed twice
+  auto statements = parser.parse();
+  EXPECT_TRUE(parser.hadError());
+  EXPECT_EQ(FlatAst::build(statements).roots().size(), statements.size());
+
+  AstArena arena;
+  EXPECT_TRUE(Parser("x * y", &arena).enableHashConsing());
+}
+
+TEST(Parser, ConstantFolding) {
+  std::vector<AstPtr<Stmt>> kept;
+  auto folded = [&](std::string_view source) {
+    Parser parser = Parser(source);
+    parser.enableConstantFolding();
+    return parseBody(parser, kept);
+  };
+
+  EXPECT_EQ(numberOf(folded("1 + 2 * 3 - 4 / 2")), 5);
+  EXPECT_EQ(numberOf(folded("(1 < 2) + (2 <= 1) + (3 == 3) + (3 != 3)")), 2);
+  EXPECT_EQ(folded("x * 1")->type(), AstType::VariableExpr);
+  EXPECT_EQ(folded("1 * (x / 1) - 0")->type(), AstType::VariableExpr);
+  // the right side folds to -0, and -0 - -0 is +0
+  EXPECT_EQ(folded("x - 0 * (0 - 1)")->type(), AstType::BinaryExpr);
+
+  // not exact under IEEE 754, kept without fast math
+  EXPECT_EQ(folded("x + 0")->type(), AstType::BinaryExpr);
+  EXPECT_EQ(folded("x * 0")->type(), AstType::BinaryExpr);
+  EXPECT_EQ(folded("x + 1 + 2")->as<const BinaryExpr *>()->left()->type(),
+            AstType::BinaryExpr);
+}
+
+TEST(Parser, FastMathFolding) {
+  AstArena arena;
+  std::vector<AstPtr<Stmt>> kept;
+  auto folded = [&](std::string_view source) {
+    Parser parser = Parser(source, &arena);
+    parser.setOptions(
+        {.hashCons = true, .foldConstants = true, .fastMath = true});
+    return parseBody(parser, kept);
+  };
+
+  EXPECT_EQ(folded("x + 0")->type(), AstType::VariableExpr);
+  EXPECT_EQ(numberOf(folded("f(x) * 0")), 0);
+
+  auto sum = folded("1 + x + 2 + 3")->as<const BinaryExpr *>();
+  EXPECT_EQ(sum->left()->type(), AstType::VariableExpr);
+  EXPECT_EQ(numberOf(sum->right()), 6);
+
+  auto product = folded("(x * y) * 2 * 4")->as<const BinaryExpr *>();
+  EXPECT_EQ(product->left()->type(), AstType::BinaryExpr);
+  EXPECT_EQ(numberOf(product->right()), 8);
+}
+
+TEST(FlatAst, PostOrderLayout) {
+  auto statements = Parser("f(1, x + 2)").parse();
+  FlatAst ast = FlatAst::build(statements);
+
+  // 1, x, 2, x + 2, f(...), expression statement
+  ASSERT_EQ(ast.size(), 6);
+  ASSERT_EQ(ast.roots().size(), 1);
+  EXPECT_EQ(ast.roots()[0], 5);
+  EXPECT_EQ(ast.subtreeStart(5), 0);
+
+  EXPECT_EQ(ast.type(4), AstType::CallExpr);
+  EXPECT_EQ(Interner::get().name(ast.symbol(4)), "f");
+  ASSERT_EQ(ast.list(4).size(), 2);
+  EXPECT_EQ(ast.list(4)[0], 0);
+  EXPECT_EQ(ast.list(4)[1], 3);
+
+  EXPECT_EQ(ast.type(3), AstType::BinaryExpr);
+  EXPECT_EQ(ast.operation(3), TokenType::Plus);
+  EXPECT_EQ(ast.subtreeStart(3), 1);
+  EXPECT_EQ(ast.number(2), 2);
+
+  FlatAst copy = ast;
+  EXPECT_EQ(copy, ast);
+  EXPECT_EQ(copy.hash(), ast.hash());
+  EXPECT_EQ(FlatAst::build(Parser("f(1, x + 2)").parse()).hash(), ast.hash());
+  EXPECT_NE(FlatAst::build(Parser("f(1, x + 3)").parse()).hash(), ast.hash());
+}
+
+TEST(Parser, OperatorPrecedence) {
+  auto statements = Parser("1 - 2 - 3 * 4 / 5 < 6").parse();
+  ASSERT_EQ(statements.size(), 1);
+
+  // ((1 - 2) - ((3 * 4) / 5)) < 6
+  auto less = statements[0]->as<ExpressionStmt *>()->body->as<BinaryExpr *>();
+  EXPECT_EQ(less->operation, TokenType::Lesser);
+
+  auto minus = less->left<BinaryExpr *>();
+  EXPECT_EQ(minus->operation, TokenType::Minus);
+  EXPECT_EQ(minus->left<BinaryExpr *>()->operation, TokenType::Minus);
+
+  auto divide = minus->right<BinaryExpr *>();
+  EXPECT_EQ(divide->operation, TokenType::Slash);
+  EXPECT_EQ(divide->left<BinaryExpr *>()->operation, TokenType::Star);
+  EXPECT_EQ(divide->right<NumberExpr *>()->value, 5);
+}
+
+TEST(Parser, DeeplyNestedExpressions) {
+  constexpr int depth = 200000;
+
+  std::string parens = std::string(depth, '(') + "1" + std::string(depth, ')');
+  auto statements = Parser(parens).parse();
+  ASSERT_EQ(statements.size(), 1);
+  EXPECT_EQ(statements[0]->as<ExpressionStmt *>()->body->type(),
+            AstType::NumberExpr);
+
+  // right nested, every `(` adds a level to the tree
+  std::string nested;
+  for (int i = 0; i < depth; i++)
+    nested += "x + (";
+  nested += "x" + std::string(depth, ')');
+
+  Parser parser = Parser(nested);
+  statements = parser.parse();
+  EXPECT_FALSE(parser.hadError());
+  ASSERT_EQ(statements.size(), 1);
+
+  std::string calls;
+  for (int i = 0; i < depth; i++)
+    calls += "f(1, ";
+  calls += "2" + std::string(depth, ')');
+
+  statements = Parser(calls).parse();
+  ASSERT_EQ(statements.size(), 1);
+  auto call = statements[0]->as<ExpressionStmt *>()->body->as<CallExpr *>();
+  EXPECT_EQ(call->args.size(), 2);
+  EXPECT_EQ(call->args[1]->type(), AstType::CallExpr);
+
+  FlatAst ast = FlatAst::build(statements);
+  EXPECT_EQ(ast.size(), 2 * depth + 2);
+}
+
+TEST(Parser, ParallelMatchesSerial) {
+  std::string source;
+  for (int i = 0; i < 200; i++) {
+    std::string name = "f" + std::to_string(i);
+    source += "def " + name + "(x, y) return x * " + std::to_string(i) +
+              " + y end\n";
+    source += name + "(1, 2.5) < 3\n";
+    source += "if " + name + "(1, 2) then return 1 else return 2 end\n";
+  }
+  // one broken definition in the middle
+  source += "def broken(x) return x + end\n";
+  source += "def last() return 4 end last()";
+
+  auto serial = Parser(source);
+  auto expected = serial.parse();
+
+  TokenBuffer tokens = TokenBuffer::scan(source);
+  ThreadPool pool(4);
+  // tiny chunks so every definition is a chunk of its own
+  ParsedModule parallel = Parser::parseParallel(tokens, pool, 1);
+
+  EXPECT_GT(parallel.arenas.size(), 200);
+  ASSERT_EQ(parallel.statements.size(), expected.size());
+  EXPECT_EQ(FlatAst::build(parallel.statements).hash(),
+            FlatAst::build(expected).hash());
+
+  ASSERT_EQ(parallel.diagnostics.count(), serial.diagnostics().count());
+  EXPECT_EQ(parallel.diagnostics.errors()[0].m_range->begin,
+            serial.diagnostics().errors()[0].m_range->begin);
+}
+
+TEST(Parser, IncrementalReparse) {
+  std::string source = "def a(x) return x + 1 end a(1)\n"
+                       "def b(x) return x * 2 end b(2)\n"
+                       "def c(x) return x - 3 end c(3)\n";
+
+  IncrementalParser parser;
+  auto first = parser.update(TokenBuffer::scan(source));
+  EXPECT_EQ(first.parsedSpans, 3);
+  EXPECT_EQ(first.changed.size(), 6);
+
+  std::vector<const Stmt *> before = parser.statements();
+
+  // edit the body of `b` and shift `c` down by a line
+  std::string edited = "def a(x) return x + 1 end a(1)\n"
+                       "def b(x) return x * 20 end b(2)\n\n"
+                       "def c(x) return x - 3 end c(3)\n";
+  auto second = parser.update(TokenBuffer::scan(edited));
+
+  EXPECT_EQ(second.reusedSpans, 2);
+  EXPECT_EQ(second.parsedSpans, 1);
+  EXPECT_EQ(second.changed, std::vector<std::size_t>({2, 3}));
+  EXPECT_EQ(second.removed, 2);
+
+  const auto &after = parser.statements();
+  ASSERT_EQ(after.size(), 6);
+  EXPECT_EQ(after[0], before[0]);
+  EXPECT_EQ(after[1], before[1]);
+  EXPECT_NE(after[2], before[2]);
+  EXPECT_EQ(after[4], before[4]);
+  EXPECT_EQ(after[5], before[5]);
+
+  auto body = after[2]->as<const FunctionStmt *>()->body.get();
+  auto product = body->returnStmt->returnValue->as<BinaryExpr *>();
+  EXPECT_EQ(static_cast<const NumberExpr *>(product->right())->value, 20);
+
+  // a broken span reports its error, fixing it parses it again
+  parser.update(TokenBuffer::scan("def a(x) return x + end"));
+  EXPECT_EQ(parser.diagnostics().count(), 1);
+  EXPECT_EQ(parser.statements().size(), 0);
+
+  auto fixed = parser.update(TokenBuffer::scan("def a(x) return x + 1 end"));
+  EXPECT_FALSE(parser.diagnostics().hasErrors());
+  EXPECT_EQ(fixed.changed.size(), 1);
+}
+
+TEST(AstCache, RoundTrip) {
+  std::string source = "def area(width, height)\n"
+                       "  let scale = 2 width = width * scale\n"
+                       "  return width * height\n"
+                       "end\n"
+                       "if area(2, 3) > 5 then return 1 else return 0 end\n"
+                       "area(4.5, 2)";
+  FlatAst ast = FlatAst::build(Parser(source).parse());
+  std::uint64_t hash = AstCache::hashSource(source);
+
+  std::string data = AstCache::serialize(ast, hash);
+  std::optional<FlatAst> loaded = AstCache::deserialize(data, hash);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(loaded.value(), ast);
+
+  // stale, from another version or damaged caches are not used
+  EXPECT_FALSE(AstCache::deserialize(data, hash + 1).has_value());
+  std::string otherVersion = data;
+  otherVersion[4] += 1;
+  EXPECT_FALSE(AstCache::deserialize(otherVersion, hash).has_value());
+  for (std::size_t length : {std::size_t(0), std::size_t(20), data.size() - 1})
+    EXPECT_FALSE(AstCache::deserialize(data.substr(0, length), hash));
+
+  std::string path = testing::TempDir() + "polylang_ast_cache_test.astc";
+  ASSERT_TRUE(AstCache::write(path, ast, hash));
+  loaded = AstCache::load(path, hash);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(loaded->hash(), ast.hash());
+  std::remove(path.c_str());
+}
+
+TEST(AstCache, RejectsMisplacedRoots) {
+  std::string source = "1 + 2";
+  std::uint64_t hash = AstCache::hashSource(source);
+  std::string path = testing::TempDir() + "polylang_ast_cache_roots.astc";
+  ASSERT_TRUE(AstCache::write(path, FlatAst::build(Parser(source).parse()),
+                              hash));
+
+  std::string data;
+  {
+    std::ifstream file(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), {});
+  }
+  // there are no names, the type of the root is the last byte of the file
+  std::size_t rootType = data.size() - 1;
+  ASSERT_EQ(data[rootType], static_cast<char>(AstType::ExpressionStmt));
+
+  // a statement that only makes sense inside a function
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(rootType);
+    file.put(static_cast<char>(AstType::ReturnStmt));
+  }
+  EXPECT_FALSE(AstCache::load(path, hash).has_value());
+
+  // a top level statement that is also the child of another
+  std::string nested = "def f(x) return x end";
+  FlatAst ast = FlatAst::build(Parser(nested).parse());
+  data = AstCache::serialize(ast, hash);
+  // The root comes before 3 name offsets, 5 node types and the names `f`
+  // and `x`. It is the function, node 4, make it its prototype, node 0.
+  std::size_t roots = data.size() - 2 - ast.size() - 3 * 4 - 4;
+  ASSERT_EQ(data.substr(roots, 4), std::string("\x04\0\0\0", 4));
+  data.replace(roots, 4, std::string(4, '\0'));
+  EXPECT_FALSE(AstCache::deserialize(data, hash).has_value());
+
+  std::remove(path.c_str());
+}